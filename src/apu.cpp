@@ -0,0 +1,668 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <stdlib.h>
+#include <string.h>
+#include "Gb_Apu.h"
+#include "Multi_Buffer.h"
+#include "apu.h"
+#include "gbx.h"
+#include "thread.h"
+
+// commands that may be waiting for the worker. a sound frame holds at most a
+// few thousand register writes, so the queue always fits more than one frame
+#define APU_QUEUE       8192
+
+// frames the worker may fall behind before the emulator waits for it, which
+// bounds how late the output of a frame is delivered
+#define APU_LAG         2
+
+#define CMD_WRITE       0   // register write at time
+#define CMD_END_FRAME   1   // end the sound frame at time
+#define CMD_CLOCK_RATE  2   // resample from a clock rate of arg Hz
+
+typedef struct apu_cmd {
+    long time;                  // cycles since the start of the sound frame
+    long arg;                   // value written or new clock rate
+    uint16_t addr;              // register written
+    uint8_t type;               // one of CMD_*
+} apu_cmd_t;
+
+// synthesizes sound from the commands queued by the emulator thread
+typedef struct apu_worker {
+    thread_t thread;
+    mutex_t lock;
+    cond_t cond;
+    apu_cmd_t cmds[APU_QUEUE];
+    long cmd_read;              // only advanced by the worker
+    long cmd_write;             // only advanced by the emulator thread
+    int frames;                 // frames queued but not yet synthesized
+    int quit;
+} apu_worker_t;
+
+// output waiting for the host, in frames of width interleaved samples. one
+// frame always stays empty, so a full ring can be told from an empty one
+typedef struct apu_ring {
+    int16_t *data;
+    long size;                  // in samples, a whole number of frames
+    long read;                  // only advanced by the host
+    long write;                 // only advanced by whoever runs synth
+    int width;                  // samples per frame
+} apu_ring_t;
+
+// another copy of Gb_Apu fed the same writes, with each oscillator mixed into
+// a buffer of its own instead of the shared stereo one
+typedef struct apu_stems {
+    Gb_Apu synth;
+    Blip_Buffer bufs[APU_STEMS];
+    apu_ring_t ring;
+} apu_stems_t;
+
+// The emulator thread owns the state copy of Gb_Apu, which never produces
+// sound and answers register reads. The synth copy is fed the same writes,
+// either directly or through the worker, and is mixed by the Stereo_Buffer
+// into a ring the host reads from.
+struct apu {
+    Gb_Apu state;
+    Gb_Apu synth;
+    Stereo_Buffer buf;
+    long clock_hz;              // nominal clock rate of the emulated cpu
+    double clock_ratio;         // adjustment applied by the host
+    int synth_on;               // waveforms are being synthesized
+    long synth_req;             // requested synthesis state, from any thread
+    int written;                // registers were written since creation
+    apu_ring_t ring;            // mixed output waiting for the host
+    apu_stems_t *stems;         // output of each oscillator, if enabled
+    apu_worker_t *worker;       // runs synth on another thread, if any
+};
+
+// ----------------------------------------------------------------------------
+// Allocate room for APU_BACKLOG_MS of output, discarding anything unread.
+static int ring_alloc(apu_ring_t *ring, long sample_rate, int width)
+{
+    long size = (sample_rate * APU_BACKLOG_MS / 1000 + 1) * width;
+
+    free(ring->data);
+    if (NULL == (ring->data = (int16_t *)malloc(size * sizeof(int16_t)))) {
+        log_err("error in APU: out of memory\n");
+        return -1;
+    }
+
+    ring->size = size;
+    ring->read = 0;
+    ring->write = 0;
+    ring->width = width;
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Return the number of samples that can be written in one piece, starting at
+// ring->data + ring->write.
+static long ring_space(apu_ring_t *ring)
+{
+    long room = ATOMIC_LOAD(&ring->read) - ring->write - ring->width;
+    if (room < 0)
+        room += ring->size;
+    return MIN(room, ring->size - ring->write);
+}
+
+// ----------------------------------------------------------------------------
+static void ring_commit(apu_ring_t *ring, long count)
+{
+    long wpos = ring->write + count;
+    ATOMIC_STORE(&ring->write, wpos == ring->size ? 0 : wpos);
+}
+
+// ----------------------------------------------------------------------------
+// Return the number of frames waiting to be read.
+static long ring_avail(apu_ring_t *ring)
+{
+    long count = ATOMIC_LOAD(&ring->write) - ring->read;
+    return (count < 0 ? count + ring->size : count) / ring->width;
+}
+
+// ----------------------------------------------------------------------------
+// Read up to count frames into dest. Returns the number of frames read.
+static long ring_read(apu_ring_t *ring, int16_t *dest, long count)
+{
+    long rpos = ring->read;
+    long n, left;
+
+    count = MIN(count, ring_avail(ring)) * ring->width;
+    for (left = count; left > 0; left -= n, dest += n) {
+        n = MIN(left, ring->size - rpos);
+        memcpy(dest, ring->data + rpos, n * sizeof(int16_t));
+        rpos += n;
+        if (rpos == ring->size)
+            rpos = 0;
+    }
+
+    ATOMIC_STORE(&ring->read, rpos);
+    return count / ring->width;
+}
+
+// ----------------------------------------------------------------------------
+// Switch synthesis on or off between sound frames. Gb_Apu skips oscillators
+// without an output, but still runs its frame sequencer for them.
+static void update_synthesis(apu_t *apu)
+{
+    int synth = (int)ATOMIC_LOAD(&apu->synth_req);
+    if (synth == apu->synth_on)
+        return;
+
+    apu->synth_on = synth;
+    if (synth) {
+        // nothing was mixed in the meantime, start again from silence
+        apu->buf.clear();
+        apu->synth.output(apu->buf.center(), apu->buf.left(),
+                          apu->buf.right());
+    }
+    else
+        apu->synth.output(NULL, NULL, NULL);
+}
+
+// ----------------------------------------------------------------------------
+// Move the mixed samples into the ring. Samples the host has no room for are
+// dropped, so a host that stops reading never holds up the emulator.
+static void fill_ring(apu_t *apu)
+{
+    apu_ring_t *ring = &apu->ring;
+    long room, count;
+
+    while (0 != (room = ring_space(ring))) {
+        count = apu->buf.read_samples(ring->data + ring->write, room);
+        if (!count)
+            break;
+        ring_commit(ring, count);
+    }
+
+    // whatever is left over is too late to be heard
+    if (apu->buf.samples_avail())
+        apu->buf.clear();
+}
+
+// ----------------------------------------------------------------------------
+// Read count samples from each oscillator buffer, interleaved into out. With
+// SSE2 every oscillator gets a lane, which gives the same samples as reading
+// the buffers one by one. The buffers are configured alike, sharing a bass.
+static void read_stems(apu_stems_t *st, int16_t *out, long count)
+{
+    const blip_long *in[APU_STEMS];
+    blip_long accum[APU_STEMS], s;
+    int bass = BLIP_READER_BASS(st->bufs[0]);
+    int osc;
+
+    for (osc = 0; osc < APU_STEMS; osc++) {
+        in[osc] = st->bufs[osc].buffer_;
+        accum[osc] = st->bufs[osc].reader_accum_;
+    }
+
+#if BLIP_BUFFER_SSE2
+    {
+        __m128i acc = _mm_loadu_si128((const __m128i *)accum);
+        __m128i shift = _mm_cvtsi32_si128(bass);
+        __m128i v[4], cur[4];
+        int i;
+
+        for (; count >= 4; count -= 4, out += 16) {
+            for (osc = 0; osc < APU_STEMS; osc++) {
+                v[osc] = _mm_loadu_si128((const __m128i *)in[osc]);
+                in[osc] += 4;
+            }
+            blip_transpose4(v);
+
+            for (i = 0; i < 4; i++) {
+                cur[i] = BLIP_READER4_READ(acc);
+                BLIP_READER4_NEXT(acc, v[i], shift);
+            }
+
+            _mm_storeu_si128((__m128i *)out, _mm_packs_epi32(cur[0], cur[1]));
+            _mm_storeu_si128((__m128i *)out + 1,
+                             _mm_packs_epi32(cur[2], cur[3]));
+        }
+
+        _mm_storeu_si128((__m128i *)accum, acc);
+    }
+#endif
+
+    for (; count > 0; count--) {
+        for (osc = 0; osc < APU_STEMS; osc++) {
+            s = accum[osc] >> (blip_sample_bits - 16);
+            *out++ = (int16_t)((int16_t)s != s ? 0x7FFF - (s >> 24) : s);
+            accum[osc] += *in[osc]++ - (accum[osc] >> bass);
+        }
+    }
+
+    for (osc = 0; osc < APU_STEMS; osc++)
+        st->bufs[osc].reader_accum_ = accum[osc];
+}
+
+// ----------------------------------------------------------------------------
+// Move the stems into their ring, dropping what doesn't fit like fill_ring.
+// The buffers are clocked alike and hold as many samples.
+static void fill_stems(apu_stems_t *st)
+{
+    apu_ring_t *ring = &st->ring;
+    long count;
+    int osc;
+
+    for (;;) {
+        count = MIN(ring_space(ring) / APU_STEMS, st->bufs[0].samples_avail());
+        if (!count)
+            break;
+
+        read_stems(st, ring->data + ring->write, count);
+        for (osc = 0; osc < APU_STEMS; osc++)
+            st->bufs[osc].remove_samples(count);
+        ring_commit(ring, count * APU_STEMS);
+    }
+
+    for (osc = 0; osc < APU_STEMS; osc++) {
+        if (st->bufs[osc].samples_avail())
+            st->bufs[osc].clear();
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Apply a command to the synth copy. Runs on the worker if there is one.
+static void run_command(apu_t *apu, const apu_cmd_t *cmd)
+{
+    apu_stems_t *st = apu->stems;
+    int osc;
+
+    switch (cmd->type) {
+    case CMD_WRITE:
+        apu->synth.write_register(cmd->time, cmd->addr, (int)cmd->arg);
+        if (st)
+            st->synth.write_register(cmd->time, cmd->addr, (int)cmd->arg);
+        break;
+    case CMD_END_FRAME:
+        apu->synth.end_frame(cmd->time);
+        if (apu->synth_on) {
+            apu->buf.end_frame(cmd->time);
+            fill_ring(apu);
+        }
+        update_synthesis(apu);
+
+        if (st) {
+            st->synth.end_frame(cmd->time);
+            for (osc = 0; osc < APU_STEMS; osc++)
+                st->bufs[osc].end_frame(cmd->time);
+            fill_stems(st);
+        }
+        break;
+    case CMD_CLOCK_RATE:
+        apu->buf.clock_rate(cmd->arg);
+        for (osc = 0; st && osc < APU_STEMS; osc++)
+            st->bufs[osc].clock_rate(cmd->arg);
+        break;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Run the commands still in the queue on the calling thread.
+static void drain_queue(apu_t *apu)
+{
+    apu_worker_t *aw = apu->worker;
+
+    while (aw->cmd_read != aw->cmd_write) {
+        run_command(apu, &aw->cmds[aw->cmd_read]);
+        aw->cmd_read = (aw->cmd_read + 1) % APU_QUEUE;
+    }
+}
+
+// ----------------------------------------------------------------------------
+static int apu_worker_run(void *data)
+{
+    apu_t *apu = (apu_t *)data;
+    apu_worker_t *aw = apu->worker;
+    apu_cmd_t *cmd;
+    int type;
+
+    mutex_lock(&aw->lock);
+    while (!aw->quit) {
+        if (!aw->frames) {
+            cond_wait(&aw->cond, &aw->lock);
+            continue;
+        }
+        mutex_unlock(&aw->lock);
+
+        // synthesize one whole frame, the emulator keeps queueing the next
+        do {
+            cmd = &aw->cmds[aw->cmd_read];
+            type = cmd->type;
+            run_command(apu, cmd);
+            ATOMIC_STORE(&aw->cmd_read, (aw->cmd_read + 1) % APU_QUEUE);
+        } while (CMD_END_FRAME != type);
+
+        mutex_lock(&aw->lock);
+        aw->frames--;
+        cond_broadcast(&aw->cond);
+    }
+    mutex_unlock(&aw->lock);
+
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Run a command on the synth copy, or queue it for the worker. Only the end
+// of a frame wakes the worker, so it handles a whole frame of writes at once.
+static void submit(apu_t *apu, int type, long time, uint16_t addr, long arg)
+{
+    apu_worker_t *aw = apu->worker;
+    apu_cmd_t cmd;
+    long next;
+
+    cmd.time = time;
+    cmd.arg = arg;
+    cmd.addr = addr;
+    cmd.type = (uint8_t)type;
+
+    if (!aw) {
+        run_command(apu, &cmd);
+        return;
+    }
+
+    next = (aw->cmd_write + 1) % APU_QUEUE;
+    if (next == ATOMIC_LOAD(&aw->cmd_read)) {
+        // the worker is a full queue behind, wait for it to finish a frame
+        mutex_lock(&aw->lock);
+        while (next == ATOMIC_LOAD(&aw->cmd_read))
+            cond_wait(&aw->cond, &aw->lock);
+        mutex_unlock(&aw->lock);
+    }
+
+    aw->cmds[aw->cmd_write] = cmd;
+    ATOMIC_STORE(&aw->cmd_write, next);
+
+    if (CMD_END_FRAME == type) {
+        mutex_lock(&aw->lock);
+        while (aw->frames >= APU_LAG)
+            cond_wait(&aw->cond, &aw->lock);
+        aw->frames++;
+        cond_broadcast(&aw->cond);
+        mutex_unlock(&aw->lock);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Block until the worker has synthesized every frame queued so far.
+static void wait_for_worker(apu_t *apu)
+{
+    apu_worker_t *aw = apu->worker;
+    if (!aw)
+        return;
+
+    mutex_lock(&aw->lock);
+    while (aw->frames)
+        cond_wait(&aw->cond, &aw->lock);
+    mutex_unlock(&aw->lock);
+}
+
+// ----------------------------------------------------------------------------
+static long clock_rate(apu_t *apu)
+{
+    return (long)(apu->clock_hz * apu->clock_ratio + 0.5);
+}
+
+// ----------------------------------------------------------------------------
+static void update_clock_rate(apu_t *apu)
+{
+    submit(apu, CMD_CLOCK_RATE, 0, 0, clock_rate(apu));
+}
+
+// ----------------------------------------------------------------------------
+static int stems_set_sample_rate(apu_stems_t *st, long sample_rate, long hz)
+{
+    const char *err;
+    int osc;
+
+    for (osc = 0; osc < APU_STEMS; osc++) {
+        if (NULL != (err = st->bufs[osc].set_sample_rate(sample_rate))) {
+            log_err("error in APU: %s\n", err);
+            return -1;
+        }
+        st->bufs[osc].clock_rate(hz);
+    }
+
+    return ring_alloc(&st->ring, sample_rate, APU_STEMS);
+}
+
+// ----------------------------------------------------------------------------
+apu_t *apu_create(long sample_rate)
+{
+    apu_t *apu = new apu_t;
+    apu->clock_hz = CPU_FREQ_DMG;
+    apu->clock_ratio = 1.0;
+    apu->synth_on = 1;
+    apu->synth_req = 1;
+    apu->written = 0;
+    apu->ring.data = NULL;
+    apu->stems = NULL;
+    apu->worker = NULL;
+
+    if (apu_set_sample_rate(apu, sample_rate)) {
+        delete apu;
+        return NULL;
+    }
+
+    apu->synth.output(apu->buf.center(), apu->buf.left(), apu->buf.right());
+    return apu;
+}
+
+// ----------------------------------------------------------------------------
+void apu_destroy(apu_t *apu)
+{
+    if (!apu)
+        return;
+
+    apu_set_thread(apu, 0);
+    apu_set_stems(apu, 0);
+    SAFE_FREE(apu->ring.data);
+    SAFE_DELETE(apu);
+}
+
+// ----------------------------------------------------------------------------
+// Change the output rate. Any samples not yet read are discarded.
+int apu_set_sample_rate(apu_t *apu, long sample_rate)
+{
+    const char *err;
+
+    // the worker sleeps until the next frame is queued, leaving buf alone
+    wait_for_worker(apu);
+
+    if (NULL != (err = apu->buf.set_sample_rate(sample_rate))) {
+        log_err("error in APU: %s\n", err);
+        return -1;
+    }
+
+    if (ring_alloc(&apu->ring, sample_rate, 2))
+        return -1;
+    if (apu->stems && stems_set_sample_rate(apu->stems, sample_rate,
+                                            clock_rate(apu)))
+        return -1;
+
+    update_clock_rate(apu);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+void apu_set_clock_rate(apu_t *apu, long hz)
+{
+    apu->clock_hz = hz;
+    update_clock_rate(apu);
+}
+
+// ----------------------------------------------------------------------------
+// Scale the clock rate the output is resampled from, so a host can keep its
+// buffering steady against a device clock that drifts from its own. A ratio
+// above 1.0 produces fewer samples for the same number of cycles.
+void apu_adjust_clock_rate(apu_t *apu, double ratio)
+{
+    apu->clock_ratio = ratio;
+    update_clock_rate(apu);
+}
+
+// ----------------------------------------------------------------------------
+// Turn waveform synthesis on or off, for instances nobody is listening to. The
+// length counters, envelopes, sweep and status bits are kept up to date either
+// way, so games reading them see no difference. Safe to call from any thread,
+// the change is made at the end of the current sound frame.
+void apu_set_synthesis(apu_t *apu, int enable)
+{
+    ATOMIC_STORE(&apu->synth_req, enable ? 1 : 0);
+}
+
+// ----------------------------------------------------------------------------
+// Move synthesis to a worker thread, or back to the caller. With a worker,
+// each frame's samples become available some time after apu_end_frame.
+int apu_set_thread(apu_t *apu, int enable)
+{
+    apu_worker_t *aw = apu->worker;
+    if (!enable == !aw)
+        return 0;
+
+    if (!enable) {
+        wait_for_worker(apu);
+        mutex_lock(&aw->lock);
+        aw->quit = 1;
+        cond_broadcast(&aw->cond);
+        mutex_unlock(&aw->lock);
+        thread_join(aw->thread);
+
+        // writes made since the last frame ended are still queued
+        drain_queue(apu);
+        cond_destroy(&aw->cond);
+        mutex_destroy(&aw->lock);
+        SAFE_FREE(apu->worker);
+        return 0;
+    }
+
+    if (NULL == (aw = (apu_worker_t *)calloc(1, sizeof(apu_worker_t))))
+        return -1;
+
+    mutex_init(&aw->lock);
+    cond_init(&aw->cond);
+    apu->worker = aw;
+
+    if (thread_create(&aw->thread, apu_worker_run, apu)) {
+        log_err("unable to start the audio thread\n");
+        cond_destroy(&aw->cond);
+        mutex_destroy(&aw->lock);
+        SAFE_FREE(apu->worker);
+        return -1;
+    }
+
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Also synthesize each oscillator on its own, read with apu_read_stems. This
+// runs another copy of the sound chip, which can't catch up on writes it
+// missed, so stems can only be enabled before the registers are first written.
+int apu_set_stems(apu_t *apu, int enable)
+{
+    apu_stems_t *st = apu->stems;
+    int osc;
+
+    if (!enable == !st)
+        return 0;
+
+    // the worker sleeps until the next frame is queued, leaving stems alone
+    wait_for_worker(apu);
+
+    if (!enable) {
+        SAFE_FREE(st->ring.data);
+        SAFE_DELETE(apu->stems);
+        return 0;
+    }
+
+    if (apu->written) {
+        log_err("APU stems must be enabled before sound is emulated\n");
+        return -1;
+    }
+
+    st = new apu_stems_t;
+    st->ring.data = NULL;
+    if (stems_set_sample_rate(st, apu->buf.sample_rate(), clock_rate(apu))) {
+        SAFE_FREE(st->ring.data);
+        SAFE_DELETE(st);
+        return -1;
+    }
+
+    for (osc = 0; osc < APU_STEMS; osc++)
+        st->synth.osc_output(osc, &st->bufs[osc]);
+
+    apu->stems = st;
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+void apu_write(apu_t *apu, long cycle, uint16_t addr, uint8_t value)
+{
+    if (addr < apu->state.start_addr || addr > apu->state.end_addr) {
+        log_err("APU write error: address %04X out of range\n", addr);
+        return;
+    }
+
+    apu->written = 1;
+    apu->state.write_register(cycle, addr, value);
+    submit(apu, CMD_WRITE, cycle, addr, value);
+}
+
+// ----------------------------------------------------------------------------
+uint8_t apu_read(apu_t *apu, long cycle, uint16_t addr)
+{
+    if (addr < apu->state.start_addr || addr > apu->state.end_addr) {
+        log_err("APU read error: address %04X out of range\n", addr);
+        return 0xFF;
+    }
+
+    return apu->state.read_register(cycle, addr);
+}
+
+// ----------------------------------------------------------------------------
+// Finish the sound frame, making its samples available to read once they are
+// synthesized. Output the host doesn't read within APU_BACKLOG_MS is dropped.
+void apu_end_frame(apu_t *apu, long cycles)
+{
+    apu->state.end_frame(cycles);
+    submit(apu, CMD_END_FRAME, cycles, 0, 0);
+}
+
+// ----------------------------------------------------------------------------
+// Return the number of stereo sample pairs waiting to be read.
+long apu_samples_avail(apu_t *apu)
+{
+    return ring_avail(&apu->ring);
+}
+
+// ----------------------------------------------------------------------------
+// Read up to count stereo sample pairs, left then right, into dest. Returns the
+// number of pairs read.
+long apu_read_samples(apu_t *apu, int16_t *dest, long count)
+{
+    return ring_read(&apu->ring, dest, count);
+}
+
+// ----------------------------------------------------------------------------
+// Read up to count frames of APU_STEMS samples, one per oscillator in the
+// order square 1, square 2, wave and noise. Returns the number of frames read.
+long apu_read_stems(apu_t *apu, int16_t *dest, long count)
+{
+    return apu->stems ? ring_read(&apu->stems->ring, dest, count) : 0;
+}
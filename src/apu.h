@@ -0,0 +1,57 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef GBOY_APU__H
+#define GBOY_APU__H
+
+#include "common.h"
+
+// sound generation, wrapping blargg's Gb_Apu. register accesses are stamped
+// with the cycle count since the start of the current sound frame, and each
+// frame's output is resampled to the host rate as 16-bit stereo sample pairs.
+// synthesis may run on a worker thread, register reads never wait for it
+
+#define APU_SAMPLE_RATE 44100   // default output rate, in Hz
+#define APU_BACKLOG_MS  100     // output kept for the host before dropping
+#define APU_STEMS       4       // oscillators, each with an optional stem
+
+typedef struct apu apu_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+apu_t  *apu_create(long sample_rate);
+void    apu_destroy(apu_t *apu);
+int     apu_set_sample_rate(apu_t *apu, long sample_rate);
+void    apu_set_clock_rate(apu_t *apu, long hz);
+void    apu_adjust_clock_rate(apu_t *apu, double ratio);
+void    apu_set_synthesis(apu_t *apu, int enable);
+int     apu_set_thread(apu_t *apu, int enable);
+int     apu_set_stems(apu_t *apu, int enable);
+void    apu_write(apu_t *apu, long cycle, uint16_t addr, uint8_t value);
+uint8_t apu_read(apu_t *apu, long cycle, uint16_t addr);
+void    apu_end_frame(apu_t *apu, long cycles);
+long    apu_samples_avail(apu_t *apu);
+long    apu_read_samples(apu_t *apu, int16_t *dest, long count);
+long    apu_read_stems(apu_t *apu, int16_t *dest, long count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GBOY_APU__H
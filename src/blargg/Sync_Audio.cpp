@@ -4,9 +4,12 @@
 #include "Sync_Audio.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <string.h>
 #include <stdlib.h>
 
+#include "common.h"
+
 /* Copyright (C) 2005-2006 by Shay Green. Permission is hereby granted, free of
 charge, to any person obtaining a copy of this software module and associated
 documentation files (the "Software"), to deal in the Software without
@@ -33,9 +36,22 @@ static const char* sdl_error( const char* str )
 
 Sync_Audio::Sync_Audio()
 {
-	buf_count = 2;
-	bufs = 0;
-	free_sem = 0;
+	ring = 0;
+	ring_size = 0;
+	read_pos = 0;
+	write_pos = 0;
+	overruns = 0;
+	underruns = 0;
+	waiting = 0;
+	low_water = 0;
+	wakeup = 0;
+	callbacks = 0;
+	short_count = 0;
+	min_fill = LONG_MAX;
+	max_gap = 0;
+	taken_callbacks = 0;
+	taken_short = 0;
+	last_callback = 0;
 	sound_open = 0;
 	set_gain( 1.0 );
 }
@@ -49,21 +65,30 @@ const char* Sync_Audio::start( long sample_rate, int chan_count, int latency )
 {
 	stop();
 	
-	write_buf = 0;
+	read_pos = 0;
 	write_pos = 0;
-	read_buf = 0;
+	overruns = 0;
+	underruns = 0;
+	callbacks = 0;
+	short_count = 0;
+	min_fill = LONG_MAX;
+	max_gap = 0;
+	taken_callbacks = 0;
+	taken_short = 0;
+	last_callback = 0;
 	
+	// one slot always stays empty to tell a full ring from an empty one
 	long sample_latency = latency * sample_rate * chan_count / 1000;
-	buf_count = sample_latency / buf_size;
-	if ( buf_count < 2 )
-		buf_count = 2;
+	if ( sample_latency < buf_size )
+		sample_latency = buf_size;
+	ring_size = sample_latency + 1;
 	
-	bufs = (sample_t*) malloc( (long) buf_size * buf_count * sizeof *bufs );
-	if ( !bufs )
+	ring = (sample_t*) malloc( ring_size * sizeof *ring );
+	if ( !ring )
 		return "Out of memory";
 	
-	free_sem = SDL_CreateSemaphore( buf_count - 1 );
-	if ( !free_sem )
+	wakeup = SDL_CreateSemaphore( 0 );
+	if ( !wakeup )
 		return sdl_error( "Couldn't create semaphore" );
 	
 	SDL_AudioSpec as;
@@ -92,80 +117,177 @@ void Sync_Audio::stop()
 		SDL_CloseAudio();
 	}
 	
-	if ( free_sem )
+	if ( wakeup )
 	{
-		SDL_DestroySemaphore( free_sem );
-		free_sem = 0;
+		SDL_DestroySemaphore( wakeup );
+		wakeup = 0;
 	}
 	
-	free( bufs );
-	bufs = 0;
+	free( ring );
+	ring = 0;
+	ring_size = 0;
 }
 
 int Sync_Audio::sample_count() const
 {
-	if ( !free_sem )
+	if ( !ring )
 		return 0;
 	
-	int buf_free = SDL_SemValue( free_sem ) * buf_size + (buf_size - write_pos);
-	return buf_size * buf_count - buf_free;
+	long count = ATOMIC_LOAD( &write_pos ) - ATOMIC_LOAD( &read_pos );
+	return count < 0 ? count + ring_size : count;
+}
+
+long Sync_Audio::overrun_count() const
+{
+	return ATOMIC_LOAD( &overruns );
 }
 
-inline Sync_Audio::sample_t* Sync_Audio::buf( int index )
+long Sync_Audio::underrun_count() const
 {
-	assert( (unsigned) index < buf_count );
-	return bufs + (long) index * buf_size;
+	return ATOMIC_LOAD( &underruns );
+}
+
+void Sync_Audio::take_stats( stats_t* out )
+{
+	// the counts are only added to by the callback, so they are reported as the
+	// difference from last time. the extremes have to be reset, and one racing
+	// with a callback may carry over into the next report, which is harmless
+	long n = ATOMIC_LOAD( &callbacks );
+	out->callbacks = n - taken_callbacks;
+	taken_callbacks = n;
+	n = ATOMIC_LOAD( &short_count );
+	out->short_count = n - taken_short;
+	taken_short = n;
+	out->min_fill = ATOMIC_XCHG( &min_fill, LONG_MAX );
+	out->max_gap = ATOMIC_XCHG( &max_gap, 0 );
+	if ( out->min_fill == LONG_MAX )
+		out->min_fill = 0;
+}
+
+bool Sync_Audio::wait_below( int count, int timeout )
+{
+	if ( !wakeup )
+		return true;
+	
+	ATOMIC_STORE( &low_water, count );
+	while ( sample_count() >= count )
+	{
+		// arm the callback, then look again in case it ran in the meantime.
+		// a wakeup left over from that case only costs another pass
+		ATOMIC_XCHG( &waiting, 1 );
+		if ( sample_count() < count )
+			break;
+		
+		if ( SDL_SemWaitTimeout( wakeup, timeout ) == SDL_MUTEX_TIMEDOUT )
+		{
+			ATOMIC_STORE( &waiting, 0 );
+			return false;
+		}
+	}
+	
+	ATOMIC_STORE( &waiting, 0 );
+	return true;
 }
 
-void Sync_Audio::write( const sample_t* in, int remain )
+int Sync_Audio::write( const sample_t* in, int count )
 {
-	while ( remain )
+	if ( !ring )
+		return 0;
+	
+	// the consumer only ever frees space, so the room seen here can't shrink
+	long wpos = write_pos;
+	long room = ATOMIC_LOAD( &read_pos ) - wpos - 1;
+	if ( room < 0 )
+		room += ring_size;
+	
+	int written = count < room ? count : (int) room;
+	if ( written < count )
+		ATOMIC_STORE( &overruns, overruns + (count - written) );
+	
+	for ( int remain = written; remain; )
 	{
-		int count = buf_size - write_pos;
-		if ( count > remain )
-			count = remain;
+		int n = (int) (ring_size - wpos);
+		if ( n > remain )
+			n = remain;
 		
-		sample_t* out = buf( write_buf ) + write_pos;
+		sample_t* out = ring + wpos;
 		if ( gain != (1L << gain_bits) )
 		{
-			register long gain = this->gain;
-			for ( int n = count; n--; )
+			long gain = this->gain;
+			for ( int i = n; i--; )
 				*out++ = (*in++ * gain) >> gain_bits;
 		}
 		else
 		{
-			memcpy( out, in, count * sizeof (sample_t) );
-			in += count;
+			memcpy( out, in, n * sizeof (sample_t) );
+			in += n;
 		}
 		
-		write_pos += count;
-		remain -= count;
-		
-		if ( write_pos >= buf_size )
-		{
-			write_pos = 0;
-			write_buf = (write_buf + 1) % buf_count;
-			SDL_SemWait( free_sem );
-		}
+		remain -= n;
+		wpos += n;
+		if ( wpos == ring_size )
+			wpos = 0;
 	}
+	
+	// publish the samples only once they have been copied
+	ATOMIC_STORE( &write_pos, wpos );
+	return written;
 }
 
 void Sync_Audio::fill_buffer( Uint8* out, int byte_count )
 {
-	if ( SDL_SemValue( free_sem ) < (unsigned int)(buf_count - 1) )
+	int count = byte_count / sizeof (sample_t);
+	long rpos = read_pos;
+	long avail = ATOMIC_LOAD( &write_pos ) - rpos;
+	if ( avail < 0 )
+		avail += ring_size;
+	
+	// note how late this callback is and how close it came to running dry
+	Uint64 now = SDL_GetPerformanceCounter();
+	if ( last_callback )
+	{
+		long gap = (long) ((now - last_callback) * 1000000 /
+				SDL_GetPerformanceFrequency());
+		if ( gap > ATOMIC_LOAD( &max_gap ) )
+			ATOMIC_STORE( &max_gap, gap );
+	}
+	last_callback = now;
+	if ( avail < ATOMIC_LOAD( &min_fill ) )
+		ATOMIC_STORE( &min_fill, avail );
+	ATOMIC_STORE( &callbacks, callbacks + 1 );
+	
+	int n = count < avail ? count : (int) avail;
+	for ( int remain = n; remain; )
 	{
-		memcpy( out, buf( read_buf ), byte_count );
-		read_buf = (read_buf + 1) % buf_count;
-		SDL_SemPost( free_sem );
+		int run = (int) (ring_size - rpos);
+		if ( run > remain )
+			run = remain;
+		
+		memcpy( out, ring + rpos, run * sizeof (sample_t) );
+		out += run * sizeof (sample_t);
+		remain -= run;
+		rpos += run;
+		if ( rpos == ring_size )
+			rpos = 0;
 	}
-	else
+	
+	// hand the space back to the producer, then pad with silence if short. the
+	// exchange keeps the check of waiting below from moving ahead of it
+	ATOMIC_XCHG( &read_pos, rpos );
+	if ( n < count )
 	{
-		memset( out, 0, byte_count );
+		memset( out, 0, (count - n) * sizeof (sample_t) );
+		ATOMIC_STORE( &underruns, underruns + (count - n) );
+		ATOMIC_STORE( &short_count, short_count + 1 );
 	}
+	
+	// wake a producer waiting for room, at most once per wait
+	if ( ATOMIC_LOAD( &waiting ) && sample_count() < ATOMIC_LOAD( &low_water ) &&
+			ATOMIC_XCHG( &waiting, 0 ) )
+		SDL_SemPost( wakeup );
 }
 
 void Sync_Audio::fill_buffer_( void* user_data, Uint8* out, int byte_count )
 {
 	((Sync_Audio*) user_data)->fill_buffer( out, byte_count );
 }
-
@@ -6,12 +6,13 @@
 
 #include "SDL.h"
 
-// Simple SDL sound wrapper that has a synchronous interface
+// Simple SDL sound wrapper. Samples are handed to the SDL callback through a
+// lock-free single-producer/single-consumer ring, so writing never blocks.
 class Sync_Audio {
 	enum { gain_bits = 16 };
 public:
-	// Initialize with specified sample rate, channel count, and latency.
-	// Returns NULL on success, otherwise error string.
+	// Initialize with specified sample rate, channel count, and latency, which
+	// sets the size of the ring. Returns NULL on success, otherwise error string.
 	const char* start( long sample_rate, int chan_count = 1, int latency_msec = 200 );
 	
 	// Set gain, where 1.0 leaves sound unaltered
@@ -20,9 +21,35 @@ public:
 	// Number of samples in buffer waiting to be played
 	int sample_count() const;
 	
-	// Write samples to buffer, first waiting until enough space is available
+	// Number of samples the buffer can hold
+	int buffer_size() const { return ring_size - 1; }
+	
+	// Write samples to buffer without waiting. Samples that don't fit are
+	// dropped and counted as overrun. Returns number of samples written.
 	typedef short sample_t;
-	void write( const sample_t*, int count );
+	int write( const sample_t*, int count );
+	
+	// Samples dropped because the buffer was full, and samples of silence
+	// played because it was empty, since start()
+	long overrun_count() const;
+	long underrun_count() const;
+	
+	// Device callbacks measured since the last call to take_stats()
+	struct stats_t {
+		long callbacks;     // callbacks made
+		long short_count;   // callbacks that ran out of samples
+		long min_fill;      // fewest samples waiting as a callback began
+		long max_gap;       // longest time between callbacks, in microseconds
+	};
+	void take_stats( stats_t* );
+	
+	// Number of samples each device callback consumes
+	int callback_size() const { return buf_size; }
+	
+	// Block until fewer than count samples are waiting to be played, which the
+	// SDL callback signals as it consumes them. Returns false if timeout_msec
+	// passed first.
+	bool wait_below( int count, int timeout_msec );
 	
 	// Stop audio output
 	void stop();
@@ -32,17 +59,25 @@ public:
 	
 private:
 	enum { buf_size = 1024 };
-	sample_t* volatile bufs;
-	SDL_sem* volatile free_sem;
-	int volatile buf_count;
-	int volatile read_buf;
-	int write_buf;
-	int write_pos;
-	// int latency;
+	sample_t* ring;
+	long ring_size;
+	long volatile read_pos;     // only advanced by the SDL callback
+	long volatile write_pos;    // only advanced by write()
+	long volatile overruns;
+	long volatile underruns;
+	long volatile waiting;      // wait_below() wants the callback to signal
+	long volatile low_water;    // fill wait_below() is waiting to drop under
+	SDL_sem* wakeup;
+	long volatile callbacks;    // only ever counted up by the SDL callback
+	long volatile short_count;
+	long volatile min_fill;     // reset by take_stats()
+	long volatile max_gap;
+	long taken_callbacks;       // counts as of the last take_stats()
+	long taken_short;
+	Uint64 last_callback;       // only touched by the SDL callback
 	long gain;
 	int sound_open;
 	
-	sample_t* buf( int index );
 	void fill_buffer( Uint8*, int );
 	static void fill_buffer_( void*, Uint8*, int );
 };
@@ -302,6 +302,38 @@ int const blip_reader_default_bass = 9;
 #define BLIP_READER_END( name, blip_buffer ) \
 	(void) ((blip_buffer).reader_accum_ = name##_reader_accum)
 
+// SSE2 reading runs up to four buffers side by side, one per 32-bit lane, and
+// gives exactly the same samples as the scalar macros above. Each buffer's
+// integrator depends on its previous sample, so lanes can't span time.
+#if !defined (BLIP_BUFFER_NO_SSE2) && (defined (__SSE2__) || defined (_M_X64) || \
+		(defined (_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define BLIP_BUFFER_SSE2 1
+	#include <emmintrin.h>
+
+// Transpose the next four samples of four buffers, so that v [i] holds sample i
+// of every buffer, in order from the lowest lane
+inline void blip_transpose4( __m128i v [4] )
+{
+	__m128i t0 = _mm_unpacklo_epi32( v [0], v [1] );
+	__m128i t1 = _mm_unpacklo_epi32( v [2], v [3] );
+	__m128i t2 = _mm_unpackhi_epi32( v [0], v [1] );
+	__m128i t3 = _mm_unpackhi_epi32( v [2], v [3] );
+	v [0] = _mm_unpacklo_epi64( t0, t1 );
+	v [1] = _mm_unpackhi_epi64( t0, t1 );
+	v [2] = _mm_unpacklo_epi64( t2, t3 );
+	v [3] = _mm_unpackhi_epi64( t2, t3 );
+}
+
+// Current sample of every lane, like BLIP_READER_READ
+#define BLIP_READER4_READ( accum )  _mm_srai_epi32( accum, blip_sample_bits - 16 )
+
+// Advance every lane by the input in, like BLIP_READER_NEXT. The bass shift
+// is a vector made with _mm_cvtsi32_si128(). Adding the input before taking
+// off the shifted accumulator wraps the same, but shortens the dependency.
+#define BLIP_READER4_NEXT( accum, in, bass ) \
+	(void) (accum = _mm_sub_epi32( _mm_add_epi32( accum, in ), _mm_sra_epi32( accum, bass ) ))
+#endif
+
 
 // Compatibility with older version
 const long blip_unscaled = 65535;
@@ -123,7 +123,12 @@ void Gb_Apu::reset()
 		0x84,0x40,0x43,0xAA,0x2D,0x78,0x92,0x3C, // wave table
 		0x60,0x59,0x59,0xB0,0x34,0xB8,0x2E,0xDA
 	};
-	memcpy( wave.wave, initial_wave, sizeof wave.wave );
+	// the table is in register form, two samples per byte
+	for ( unsigned i = 0; i < sizeof initial_wave; i++ )
+	{
+		wave.wave [i * 2] = initial_wave [i] >> 4;
+		wave.wave [i * 2 + 1] = initial_wave [i] & 0x0F;
+	}
 }
 
 void Gb_Apu::run_until( blip_time_t end_time )
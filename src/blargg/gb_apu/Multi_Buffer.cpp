@@ -62,6 +62,8 @@ Stereo_Buffer::Stereo_Buffer() : Multi_Buffer( 2 )
 	chan.center = &bufs [0];
 	chan.left = &bufs [1];
 	chan.right = &bufs [2];
+	stereo_added = 0;
+	was_stereo   = false;
 }
 
 Stereo_Buffer::~Stereo_Buffer() { }
@@ -148,6 +150,68 @@ long Stereo_Buffer::read_samples( blip_sample_t* out, long count )
 	return count * 2;
 }
 
+#if BLIP_BUFFER_SSE2
+// Mixes four samples at a time with lanes for center, left and right, leaving
+// the remainder to the scalar loop. A null center reads as silence.
+static blargg_long mix_stereo_sse2( blip_sample_t* BLIP_RESTRICT& out_, blargg_long count,
+		int bass_shift, const blip_long* BLIP_RESTRICT& center_, blip_long& center_accum,
+		const blip_long* BLIP_RESTRICT& left_, blip_long& left_accum,
+		const blip_long* BLIP_RESTRICT& right_, blip_long& right_accum )
+{
+	static blip_long const silence [4] = { 0, 0, 0, 0 };
+	blip_sample_t* BLIP_RESTRICT out = out_;
+	const blip_long* BLIP_RESTRICT center = center_ ? center_ : silence;
+	const blip_long* BLIP_RESTRICT left = left_;
+	const blip_long* BLIP_RESTRICT right = right_;
+	int const center_step = center_ ? 4 : 0;
+	blargg_long const blocks = count >> 2;
+	
+	__m128i const bass = _mm_cvtsi32_si128( bass_shift );
+	__m128i accum = _mm_set_epi32( 0, right_accum, left_accum, center_ ? center_accum : 0 );
+	
+	for ( blargg_long n = blocks; n; --n )
+	{
+		__m128i in [4];
+		in [0] = _mm_loadu_si128( (const __m128i*) center );
+		in [1] = _mm_loadu_si128( (const __m128i*) left );
+		in [2] = _mm_loadu_si128( (const __m128i*) right );
+		in [3] = _mm_setzero_si128();
+		blip_transpose4( in );
+		
+		__m128i s [4];
+		for ( int i = 0; i < 4; i++ )
+		{
+			s [i] = BLIP_READER4_READ( accum );
+			BLIP_READER4_NEXT( accum, in [i], bass );
+		}
+		
+		// back to four samples of center, left and right, then mix. the
+		// scalar clamp saturates, since the sums stay well within 24 bits
+		blip_transpose4( s );
+		__m128i l = _mm_add_epi32( s [0], s [1] );
+		__m128i r = _mm_add_epi32( s [0], s [2] );
+		_mm_storeu_si128( (__m128i*) out, _mm_packs_epi32(
+				_mm_unpacklo_epi32( l, r ), _mm_unpackhi_epi32( l, r ) ) );
+		out += 8;
+		center += center_step;
+		left += 4;
+		right += 4;
+	}
+	
+	out_ = out;
+	left_ = left;
+	right_ = right;
+	if ( center_ )
+	{
+		center_ = center;
+		center_accum = _mm_cvtsi128_si32( accum );
+	}
+	left_accum  = _mm_cvtsi128_si32( _mm_shuffle_epi32( accum, _MM_SHUFFLE( 3, 3, 3, 1 ) ) );
+	right_accum = _mm_cvtsi128_si32( _mm_shuffle_epi32( accum, _MM_SHUFFLE( 3, 3, 3, 2 ) ) );
+	return count & 3;
+}
+#endif
+
 void Stereo_Buffer::mix_stereo( blip_sample_t* out_, blargg_long count )
 {
 	blip_sample_t* BLIP_RESTRICT out = out_;
@@ -156,6 +220,11 @@ void Stereo_Buffer::mix_stereo( blip_sample_t* out_, blargg_long count )
 	BLIP_READER_BEGIN( right, bufs [2] );
 	BLIP_READER_BEGIN( center, bufs [0] );
 	
+	#if BLIP_BUFFER_SSE2
+		count = mix_stereo_sse2( out, count, bass, center_reader_buf, center_reader_accum,
+				left_reader_buf, left_reader_accum, right_reader_buf, right_reader_accum );
+	#endif
+	
 	for ( ; count; --count )
 	{
 		int c = BLIP_READER_READ( center );
@@ -188,6 +257,13 @@ void Stereo_Buffer::mix_stereo_no_center( blip_sample_t* out_, blargg_long count
 	BLIP_READER_BEGIN( left, bufs [1] );
 	BLIP_READER_BEGIN( right, bufs [2] );
 	
+	#if BLIP_BUFFER_SSE2
+		const blip_long* BLIP_RESTRICT no_center = 0;
+		blip_long no_center_accum = 0;
+		count = mix_stereo_sse2( out, count, bass, no_center, no_center_accum,
+				left_reader_buf, left_reader_accum, right_reader_buf, right_reader_accum );
+	#endif
+	
 	for ( ; count; --count )
 	{
 		blargg_long l = BLIP_READER_READ( left );
@@ -29,6 +29,9 @@
 // Uncomment to use faster, lower quality sound synthesis
 //#define BLIP_BUFFER_FAST 1
 
+// Uncomment to read samples without SSE2 even where it is available
+//#define BLIP_BUFFER_NO_SSE2 1
+
 // Uncomment if automatic byte-order determination doesn't work
 //#define BLARGG_BIG_ENDIAN 1
 
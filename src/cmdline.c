@@ -31,32 +31,107 @@
 #define CMDLINE_SYSTEM_GBA      1005
 #define CMDLINE_LOG_SERIAL      1006
 #define CMDLINE_NO_SOUND        1007
+#define CMDLINE_RENDER_THREAD   1008
+#define CMDLINE_COLOR           1009
+#define CMDLINE_GHOSTING        1010
+#define CMDLINE_FRAMES          1011
+#define CMDLINE_DUMP_FRAMES     1012
+#define CMDLINE_WAV             1013
+#define CMDLINE_RECORD          1014
+#define CMDLINE_AUDIO_THREAD    1015
+#define CMDLINE_PCM             1016
+#define CMDLINE_STEMS           1017
+#define CMDLINE_SYNC            1018
+
+#define FE_ALL                  (CMDLINE_FE_SDL | CMDLINE_FE_HEADLESS)
+#define FE_SDL                  CMDLINE_FE_SDL
+#define FE_HL                   CMDLINE_FE_HEADLESS
+
+// every option, the frontends that accept it, and its line in the usage text.
+// each frontend only parses and lists its own, so the rest are rejected
+typedef struct cmdline_opt {
+    const char *name;
+    int has_arg;
+    int val;
+    int frontends;
+    const char *help;
+} cmdline_opt_t;
+
+static const cmdline_opt_t s_options[] = {
+    { "audio-thread",   no_argument,        CMDLINE_AUDIO_THREAD,   FE_SDL,
+      "      --audio-thread       synthesize sound on a separate thread\n" },
+    { "bios-dir",       required_argument,  'b',                    FE_ALL,
+      "  -b, --bios-dir=PATH      specify where bios files are located\n" },
+    { "color",          required_argument,  CMDLINE_COLOR,          FE_ALL,
+      "      --color=PROFILE      CGB colors: raw, lcd, or a gamma value\n" },
+    { "debugger",       no_argument,        'd',                    FE_ALL,
+      "  -d, --debugger           enable debugging interface\n" },
+    { "dump-frames",    required_argument,  CMDLINE_DUMP_FRAMES,    FE_HL,
+      "      --dump-frames=PATH   write frames (.ppm, .png, raw) to PATH\n" },
+    { "fullscreen",     no_argument,        'f',                    FE_SDL,
+      "  -f, --fullscreen         run in fullscreen mode\n" },
+    { "frames",         required_argument,  CMDLINE_FRAMES,         FE_HL,
+      "      --frames=COUNT       stop after COUNT frames (0 = no limit)\n" },
+    { "ghosting",       required_argument,  CMDLINE_GHOSTING,       FE_ALL,
+      "      --ghosting=WEIGHT    blend in past frames (0-255, 0 = off)\n" },
+    { "log-serial",     required_argument,  CMDLINE_LOG_SERIAL,     FE_ALL,
+      "      --log-serial=PATH    log serial output to the specified file\n" },
+    { "no-sound",       no_argument,        CMDLINE_NO_SOUND,       FE_SDL,
+      "      --no-sound           disable sound playback\n" },
+    { "pcm",            required_argument,  CMDLINE_PCM,            FE_HL,
+      "      --pcm=PATH           write audio to PATH as raw 16-bit PCM\n" },
+    { "render-thread",  no_argument,        CMDLINE_RENDER_THREAD,  FE_SDL,
+      "      --render-thread      render frames on a separate thread\n" },
+    { "record",         required_argument,  CMDLINE_RECORD,         FE_ALL,
+      "      --record=PATH        stream frames to PATH (.y4m, else RGBA)\n" },
+    { "rom",            required_argument,  'r',                    FE_ALL,
+      "  -r, --rom=PATH           path to rom file\n" },
+    { "scale",          required_argument,  's',                    FE_SDL,
+      "  -s, --scale=INT          scale screen resolution\n" },
+    { "stems",          required_argument,  CMDLINE_STEMS,          FE_HL,
+      "      --stems=PATH         sound channels to PATH (.wav, else raw)\n" },
+    { "stretch",        no_argument,        'S',                    FE_SDL,
+      "  -S, --stretch            stretch image to fill screen\n" },
+    { "sync",           required_argument,  CMDLINE_SYNC,           FE_SDL,
+      "      --sync=MODE          emulation pacing: timer (default), audio\n" },
+    { "system-dmg",     no_argument,        CMDLINE_SYSTEM_DMG,     FE_ALL,
+      "      --system-dmg         force system type to original game boy\n" },
+    { "system-cgb",     no_argument,        CMDLINE_SYSTEM_CGB,     FE_ALL,
+      "      --system-cgb         force system type to game boy color\n" },
+    { "system-sgb",     no_argument,        CMDLINE_SYSTEM_SGB,     FE_ALL,
+      "      --system-sgb         force system type to super game boy\n" },
+    { "system-sgb2",    no_argument,        CMDLINE_SYSTEM_SGB2,    FE_ALL,
+      "      --system-sgb2        force system type to super game boy 2\n" },
+    { "system-gba",     no_argument,        CMDLINE_SYSTEM_GBA,     FE_ALL,
+      "      --system-gba         force system type to game boy advance\n" },
+    { "unlock",         no_argument,        'u',                    FE_SDL,
+      "  -u, --unlock             unlock cpu throttling (no speed limit)\n" },
+    { "vsync",          no_argument,        'v',                    FE_SDL,
+      "  -v, --vsync              enable vertical sync\n" },
+    { "wav",            required_argument,  CMDLINE_WAV,            FE_HL,
+      "      --wav=PATH           write audio to a WAV file or pipe\n" },
+    { "help",           no_argument,        'h',                    FE_ALL,
+      "  -h, --help               display this usage message\n" },
+    { "version",        no_argument,        CMDLINE_VERSION,        FE_ALL,
+      "      --version            display program version\n" },
+};
+
+#define OPTION_COUNT    (sizeof(s_options) / sizeof(s_options[0]))
 
 const char *gboy_desc   = "gboy - a portable gameboy emulator";
-const char *gboy_usage  = "usage: gboy [options] [file]";
 
 // ----------------------------------------------------------------------------
-void cmdline_display_usage(void)
+void cmdline_display_usage(int frontend)
 {
-    log_info("%s\n%s\n\n", gboy_desc, gboy_usage);
-    log_info("Options:\n"
-        "  -b, --bios-dir=PATH      specify where bios files are located\n"
-        "  -d, --debugger           enable debugging interface\n"
-        "  -f, --fullscreen         run in fullscreen mode\n"
-        "      --log-serial=PATH    log serial output to the specified file\n"
-        "      --no-sound           disable sound playback\n"
-        "  -r, --rom=PATH           path to rom file\n"
-        "  -s, --scale=INT          scale screen resolution\n"
-        "  -S, --stretch            stretch image to fill screen\n"
-        "      --system-dmg         force system type to original game boy\n"
-        "      --system-cgb         force system type to game boy color\n"
-        "      --system-sgb         force system type to super game boy\n"
-        "      --system-sgb2        force system type to super game boy 2\n"
-        "      --system-gba         force system type to game boy advance\n"
-        "  -u, --unlock             unlock cpu throttling (no speed limit)\n"
-        "  -v, --vsync              enable vertical sync\n"
-        "  -h, --help               display this usage message\n"
-        "      --version            display program version\n");
+    unsigned i;
+
+    log_info("%s\nusage: %s [options] [file]\n\n", gboy_desc,
+             (frontend == CMDLINE_FE_HEADLESS) ? "gboy_headless" : "gboy");
+    log_info("Options:\n");
+    for (i = 0; i < OPTION_COUNT; i++) {
+        if (s_options[i].frontends & frontend)
+            log_info("%s", s_options[i].help);
+    }
     exit(EXIT_FAILURE);
 }
 
@@ -69,31 +144,34 @@ void cmdline_display_version(void)
 }
 
 // ----------------------------------------------------------------------------
-int cmdline_parse(int argc, char *argv[], cmdargs_t *args)
+int cmdline_parse(int argc, char *argv[], cmdargs_t *args, int frontend)
 {
-    static const char *s_opts = "b:dfr:s:Suvh?";
-    static const struct option l_opts[] = {
-        { "bios-dir",       required_argument,  NULL, 'b' },
-        { "debugger",       no_argument,        NULL, 'd' },
-        { "fullscreen",     no_argument,        NULL, 'f' },
-        { "log-serial",     required_argument,  NULL, CMDLINE_LOG_SERIAL },
-        { "no-sound",       no_argument,        NULL, CMDLINE_NO_SOUND },
-        { "rom",            required_argument,  NULL, 'r' },
-        { "scale",          required_argument,  NULL, 's' },
-        { "stretch",        no_argument,        NULL, 'S' },
-        { "system-dmg",     no_argument,        NULL, CMDLINE_SYSTEM_DMG },
-        { "system-cgb",     no_argument,        NULL, CMDLINE_SYSTEM_CGB },
-        { "system-sgb",     no_argument,        NULL, CMDLINE_SYSTEM_SGB },
-        { "system-sgb2",    no_argument,        NULL, CMDLINE_SYSTEM_SGB2 },
-        { "system-gba",     no_argument,        NULL, CMDLINE_SYSTEM_GBA },
-        { "unlock",         no_argument,        NULL, 'u' },
-        { "vsync",          no_argument,        NULL, 'v' },
-        { "help",           no_argument,        NULL, 'h' },
-        { "version",        no_argument,        NULL, CMDLINE_VERSION },
-        { NULL,             no_argument,        NULL, 0 }
-    };
+    struct option l_opts[OPTION_COUNT + 1];
+    char s_opts[OPTION_COUNT * 2 + 2];
+    unsigned i, n = 0, len = 0;
     int opt, index = 0, scale = 1;
 
+    // gather the options of this frontend, the short ones into a string
+    for (i = 0; i < OPTION_COUNT; i++) {
+        if (!(s_options[i].frontends & frontend))
+            continue;
+
+        l_opts[n].name = s_options[i].name;
+        l_opts[n].has_arg = s_options[i].has_arg;
+        l_opts[n].flag = NULL;
+        l_opts[n].val = s_options[i].val;
+        n++;
+
+        if (s_options[i].val < 0x80) {
+            s_opts[len++] = (char)s_options[i].val;
+            if (s_options[i].has_arg == required_argument)
+                s_opts[len++] = ':';
+        }
+    }
+    memset(&l_opts[n], 0, sizeof(struct option));
+    s_opts[len++] = '?';
+    s_opts[len] = '\0';
+
     // set some reasonable defaults
     args->system = SYSTEM_AUTO;
     args->debugger = 0;
@@ -102,9 +180,21 @@ int cmdline_parse(int argc, char *argv[], cmdargs_t *args)
     args->unlock = 0;
     args->vsync = 0;
     args->enable_sound = 1;
+    args->render_thread = 0;
+    args->audio_thread = 0;
+    args->sync_mode = SYNC_TIMER;
+    args->color_profile = GBX_COLOR_RAW;
+    args->color_gamma = 1.0f;
+    args->ghosting = 0;
+    args->frames = 0;
     args->rom_path = NULL;
     args->bios_path = NULL;
     args->serial_path = NULL;
+    args->frame_path = NULL;
+    args->wav_path = NULL;
+    args->pcm_path = NULL;
+    args->stems_path = NULL;
+    args->record_path = NULL;
 
     while (-1 != (opt = getopt_long(argc, argv, s_opts, l_opts, &index))) {
         switch (opt) {
@@ -156,9 +246,54 @@ int cmdline_parse(int argc, char *argv[], cmdargs_t *args)
         case CMDLINE_NO_SOUND:
             args->enable_sound = 0;
             break;
+        case CMDLINE_RENDER_THREAD:
+            args->render_thread = 1;
+            break;
+        case CMDLINE_AUDIO_THREAD:
+            args->audio_thread = 1;
+            break;
+        case CMDLINE_COLOR:
+            if (!strcmp(optarg, "raw"))
+                args->color_profile = GBX_COLOR_RAW;
+            else if (!strcmp(optarg, "lcd"))
+                args->color_profile = GBX_COLOR_LCD;
+            else {
+                args->color_profile = GBX_COLOR_GAMMA;
+                args->color_gamma = (float)strtod(optarg, NULL);
+            }
+            break;
+        case CMDLINE_SYNC:
+            if (!strcmp(optarg, "timer"))
+                args->sync_mode = SYNC_TIMER;
+            else if (!strcmp(optarg, "audio"))
+                args->sync_mode = SYNC_AUDIO;
+            else
+                args->sync_mode = -1;
+            break;
+        case CMDLINE_GHOSTING:
+            args->ghosting = strtol(optarg, NULL, 0);
+            break;
+        case CMDLINE_FRAMES:
+            args->frames = strtol(optarg, NULL, 0);
+            break;
+        case CMDLINE_DUMP_FRAMES:
+            args->frame_path = strdup(optarg);
+            break;
+        case CMDLINE_WAV:
+            args->wav_path = strdup(optarg);
+            break;
+        case CMDLINE_PCM:
+            args->pcm_path = strdup(optarg);
+            break;
+        case CMDLINE_STEMS:
+            args->stems_path = strdup(optarg);
+            break;
+        case CMDLINE_RECORD:
+            args->record_path = strdup(optarg);
+            break;
         case 'h':
         case '?':
-            cmdline_display_usage();
+            cmdline_display_usage(frontend);
             break;
         default:
             break;
@@ -179,6 +314,26 @@ int cmdline_parse(int argc, char *argv[], cmdargs_t *args)
         return -1;
     }
 
+    if (args->color_gamma <= 0.0f) {
+        log_err("invalid color profile specified (raw, lcd or gamma > 0)\n");
+        return -1;
+    }
+
+    if (args->sync_mode < 0) {
+        log_err("invalid sync mode specified (timer or audio)\n");
+        return -1;
+    }
+
+    if (args->ghosting < 0 || args->ghosting > 255) {
+        log_err("invalid ghosting weight specified (must be 0-255)\n");
+        return -1;
+    }
+
+    if (args->frames < 0) {
+        log_err("invalid frame count specified (must be >= 0)\n");
+        return -1;
+    }
+
     if (scale <= 0 || scale > 10) {
         log_err("invalid scale factor specified (must be 0-20)\n");
         return -1;
@@ -193,6 +348,11 @@ int cmdline_parse(int argc, char *argv[], cmdargs_t *args)
 void cmdline_destroy(cmdargs_t *args)
 {
     assert(NULL != args);
+    SAFE_FREE(args->record_path);
+    SAFE_FREE(args->wav_path);
+    SAFE_FREE(args->pcm_path);
+    SAFE_FREE(args->stems_path);
+    SAFE_FREE(args->frame_path);
     SAFE_FREE(args->serial_path);
     SAFE_FREE(args->bios_path);
     SAFE_FREE(args->rom_path);
@@ -18,6 +18,14 @@
 #ifndef GBOY_CMDLINE__H
 #define GBOY_CMDLINE__H
 
+// frontends, each of which only accepts and lists the options it uses
+#define CMDLINE_FE_SDL      0x01
+#define CMDLINE_FE_HEADLESS 0x02
+
+// what paces the emulator when the speed is limited
+#define SYNC_TIMER          0   // sleep between updates on the system timer
+#define SYNC_AUDIO          1   // run whenever the sound device needs samples
+
 typedef struct cmdargs {
     int system;         // type of system to emulate
     int debugger;       // enable debugging interface
@@ -28,14 +36,26 @@ typedef struct cmdargs {
     int stretch;        // stretch image to fill screen
     int unlock;         // unlock cpu throttling
     int enable_sound;   // enable or disable sound playback
+    int render_thread;  // render frames on a separate thread
+    int audio_thread;   // synthesize sound on a separate thread
+    int sync_mode;      // what paces the emulator (SYNC_TIMER, SYNC_AUDIO)
+    int color_profile;  // conversion of CGB colors for display
+    float color_gamma;  // gamma exponent for custom color profile
+    int ghosting;       // weight of previous frames blended into each one
+    int frames;         // number of frames to run for, 0 to run forever
     char *rom_path;     // path to rom image
     char *bios_path;    // path to bios directory
     char *serial_path;  // path to serial log file
+    char *frame_path;   // path (or pattern) frames are written to
+    char *wav_path;     // path audio is written to as a WAV file
+    char *pcm_path;     // path audio is written to as raw 16-bit PCM
+    char *stems_path;   // path each sound channel is written to
+    char *record_path;  // path frames are streamed to for encoding
 } cmdargs_t;
 
-int cmdline_parse(int argc, char *argv[], cmdargs_t *args);
+int cmdline_parse(int argc, char *argv[], cmdargs_t *args, int frontend);
 void cmdline_destroy(cmdargs_t *args);
-void cmdline_display_usage(void);
+void cmdline_display_usage(int frontend);
 void cmdline_display_version(void);
 
 #endif // GBOY_CMDLINE__H
@@ -51,6 +51,30 @@ typedef unsigned long long uint64_t;
 
 #define UNUSED_VARIABLE(x)  (void)(x)
 
+// atomic primitives used to hand data between the emulator and its frontends
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ATOMIC_LOAD(p)      (_ReadWriteBarrier(), *(volatile long *)(p))
+#define ATOMIC_STORE(p, v)  _InterlockedExchange((volatile long *)(p), (v))
+#define ATOMIC_XCHG(p, v)   _InterlockedExchange((volatile long *)(p), (v))
+#else
+#define ATOMIC_LOAD(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ATOMIC_XCHG(p, v)   __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#endif
+
+// SIMD instruction sets the pixel kernels may be compiled for
+
+#if defined(__AVX2__)
+#define SIMD_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(ARCH_X86_64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2
+#endif
+
 #ifndef MIN
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
 #endif
@@ -46,6 +46,19 @@ int gbx_create_context(gbx_context_t **pctx, int system)
     ctx->video.state = VIDEO_STATE_VBLANK;
     ctx->video.cycle = VIDEO_CYCLES_TRANSFER;
 
+    // render into buffer 0, buffer 1 is published and buffer 2 is displayed
+    ctx->fb_back = 0;
+    ctx->fb_ready = 1;
+    ctx->fb_front = 2;
+    ctx->fb_last_seq = -1;
+    gbx_set_framebuffer_target(ctx, NULL, 0, GBX_PIXEL_RGBX8888);
+
+    if (NULL == (ctx->apu = apu_create(APU_SAMPLE_RATE))) {
+        log_err("Failed to create the APU.\n");
+        SAFE_FREE(ctx);
+        return -1;
+    }
+
     *pctx = ctx;
     return 0;
 }
@@ -58,11 +71,16 @@ void gbx_destroy_context(gbx_context_t *ctx)
         return;
     }
 
+    gbx_set_render_thread(ctx, 0);
+    apu_destroy(ctx->apu);
     SAFE_FREE(ctx->mem.bios);
     SAFE_FREE(ctx->mem.wram);
     SAFE_FREE(ctx->mem.vram);
     SAFE_FREE(ctx->mem.xram);
     SAFE_FREE(ctx->mem.xrom);
+    SAFE_FREE(ctx->video.jobs[0].writes);
+    SAFE_FREE(ctx->video.jobs[1].writes);
+    SAFE_FREE(ctx->video.blend_acc);
     SAFE_FREE(ctx);
 }
 
@@ -211,6 +229,7 @@ static int alloc_memory_regions(gbx_context_t *ctx, uint8_t *rom, size_t size)
     if (vram_size) {
         ctx->mem.vram = calloc(1, vram_size);
         ctx->mem.vram_bank = ctx->mem.vram;
+        memset(ctx->video.vram_dirty, 0xFF, sizeof(ctx->video.vram_dirty));
         log_info("  Internal VRAM: %d KB\n", vram_size >> 10);
     }
 
@@ -378,12 +397,178 @@ void gbx_set_input_state(gbx_context_t *ctx, int key, int pressed)
         ctx->input_state |= (1 << key);
 }
 
+// ----------------------------------------------------------------------------
+// Render into caller memory holding GBX_FB_COUNT frames, or NULL for our own.
+int gbx_set_framebuffer_target(gbx_context_t *ctx, void *ptr, int pitch,
+                               int format)
+{
+    int row_bytes;
+    assert(NULL != ctx);
+
+    if (format < 0 || format > GBX_PIXEL_LAST) {
+        log_err("Invalid framebuffer pixel format (%d) specified.\n", format);
+        return -1;
+    }
+
+    // rows must stay 32-bit aligned so that pixels can be stored directly
+    row_bytes = video_row_bytes(format);
+    if (NULL == ptr)
+        pitch = row_bytes;
+    else if (pitch < row_bytes || (pitch & 3) || ((uintptr_t)ptr & 3)) {
+        log_err("Invalid framebuffer target %p (pitch %d).\n", ptr, pitch);
+        return -1;
+    }
+
+    video_set_output(ctx, (uint8_t *)ptr, pitch, format);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Select how CGB colors are converted, gamma only for GBX_COLOR_GAMMA.
+int gbx_set_color_profile(gbx_context_t *ctx, int profile, float gamma)
+{
+    assert(NULL != ctx);
+
+    if (profile < 0 || profile > GBX_COLOR_LAST) {
+        log_err("Invalid color profile (%d) specified.\n", profile);
+        return -1;
+    }
+
+    if (profile == GBX_COLOR_GAMMA && gamma <= 0.0f) {
+        log_err("Invalid color gamma (%f) specified.\n", gamma);
+        return -1;
+    }
+
+    video_set_color_profile(ctx, profile, gamma);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Blend in previous frames with a weight out of 256, 0 to disable.
+int gbx_set_frame_blend(gbx_context_t *ctx, int weight)
+{
+    assert(NULL != ctx);
+
+    if (weight < 0 || weight > 255) {
+        log_err("Invalid frame blend weight (%d) specified.\n", weight);
+        return -1;
+    }
+
+    return video_set_frame_blend(ctx, weight);
+}
+
+// ----------------------------------------------------------------------------
+// Take the newest frame, returning non-zero if it was not acquired before.
+int gbx_acquire_frame(gbx_context_t *ctx, gbx_frame_t *frame)
+{
+    int fresh = 0;
+    assert(NULL != ctx);
+    assert(NULL != frame);
+
+    if (ATOMIC_LOAD(&ctx->fb_ready) & FB_FRESH) {
+        // swap our stale buffer for the newly published one
+        ctx->fb_front = ATOMIC_XCHG(&ctx->fb_ready, ctx->fb_front) & FB_INDEX;
+        fresh = 1;
+    }
+
+    *frame = ctx->fb_slot[ctx->fb_front];
+
+    // rows are flagged relative to the frame before, so if any frames were
+    // dropped in between, the whole frame must be presented again
+    if (!fresh)
+        memset(frame->dirty, 0, sizeof(frame->dirty));
+    else if (frame->seq != ctx->fb_last_seq + 1)
+        memset(frame->dirty, 0xFF, sizeof(frame->dirty));
+
+    ctx->fb_last_seq = frame->seq;
+    return fresh;
+}
+
+// ----------------------------------------------------------------------------
+// Select the output rate in Hz, discarding any sound not yet read.
+int gbx_set_audio_rate(gbx_context_t *ctx, long sample_rate)
+{
+    assert(NULL != ctx);
+
+    if (sample_rate <= 0) {
+        log_err("Invalid audio sample rate (%ld) specified.\n", sample_rate);
+        return -1;
+    }
+
+    return apu_set_sample_rate(ctx->apu, sample_rate);
+}
+
+// ----------------------------------------------------------------------------
+// Scale the samples produced per cycle by 1 / ratio, kept close to 1.0.
+void gbx_adjust_audio_clock(gbx_context_t *ctx, double ratio)
+{
+    assert(NULL != ctx);
+    apu_adjust_clock_rate(ctx->apu, ratio);
+}
+
+// ----------------------------------------------------------------------------
+// Synthesize sound on a worker thread, trailing each sound frame a little.
+int gbx_set_audio_thread(gbx_context_t *ctx, int enable)
+{
+    assert(NULL != ctx);
+    return apu_set_thread(ctx->apu, enable);
+}
+
+// ----------------------------------------------------------------------------
+// Also render each oscillator to a mono stem, enabled before power on.
+int gbx_set_audio_stems(gbx_context_t *ctx, int enable)
+{
+    assert(NULL != ctx);
+    return apu_set_stems(ctx->apu, enable);
+}
+
+// ----------------------------------------------------------------------------
+// Generate sound, or only track the registers, from the next sound frame.
+void gbx_set_audio_synthesis(gbx_context_t *ctx, int enable)
+{
+    assert(NULL != ctx);
+    apu_set_synthesis(ctx->apu, enable);
+}
+
+// ----------------------------------------------------------------------------
+// Return the number of stereo sample pairs ready to be read.
+long gbx_audio_avail(gbx_context_t *ctx)
+{
+    assert(NULL != ctx);
+    return apu_samples_avail(ctx->apu);
+}
+
+// ----------------------------------------------------------------------------
+// Read up to count interleaved 16-bit stereo pairs, returning pairs read.
+long gbx_read_audio(gbx_context_t *ctx, int16_t *dest, long count)
+{
+    assert(NULL != ctx);
+    assert(NULL != dest);
+    return apu_read_samples(ctx->apu, dest, count);
+}
+
+// ----------------------------------------------------------------------------
+// Read up to count frames of APU_STEMS samples, in step with the pairs.
+long gbx_read_audio_stems(gbx_context_t *ctx, int16_t *dest, long count)
+{
+    assert(NULL != ctx);
+    assert(NULL != dest);
+    return apu_read_stems(ctx->apu, dest, count);
+}
+
 // ----------------------------------------------------------------------------
 void gbx_get_framebuffer(gbx_context_t *ctx, uint32_t *dest)
 {
+    int ready;
     assert(NULL != ctx);
     assert(NULL != dest);
-    memcpy(dest, ctx->fb, GBX_LCD_XRES * GBX_LCD_YRES * 4);
+
+    // copy out the newest frame as RGBX8888, leaving it to be acquired
+    ready = ATOMIC_LOAD(&ctx->fb_ready);
+    if (ready & FB_FRESH)
+        gbx_expand_frame(ctx, &ctx->fb_slot[ready & FB_INDEX], dest);
+    else
+        gbx_expand_frame(ctx, &ctx->fb_slot[ctx->fb_front], dest);
 }
 
 // ----------------------------------------------------------------------------
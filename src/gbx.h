@@ -22,6 +22,7 @@
 extern "C" {
 #endif
 
+#include "apu.h"
 #include "cpu.h"
 #include "logging.h"
 #include "memory.h"
@@ -58,6 +59,10 @@ extern "C" {
 #define CPU_FREQ_SGB2   4194304 // corrected from SGB, same as DMG
 #define CPU_FREQ_GBA    8388608 // operating in GBC mode (max speed mode)
 
+// cycles between sound frames, each making the sound generated so far
+// available to the host. kept short so it can run with little audio buffered
+#define SOUND_FRAME_CYCLES  16384
+
 // execution interruption flags
 
 #define EXEC_BREAK      0x01
@@ -65,6 +70,23 @@ extern "C" {
 #define EXEC_HALT       0x04
 #define EXEC_STOP       0x08
 
+// most recently completed frame, as seen by the display thread
+
+typedef struct gbx_frame {
+    const void *pixels;         // first of GBX_LCD_YRES rows of GBX_LCD_XRES
+    int pitch;                  // distance in bytes from one row to the next
+    int format;                 // layout of each pixel, one of GBX_PIXEL_*
+    long seq;                   // number of frames completed before this one
+    long cycles;                // emulated cycle count when it was completed
+    uint32_t dirty[GBX_DIRTY_WORDS]; // rows changed since the last acquired
+} gbx_frame_t;
+
+// area of a debug view that was redrawn, in pixels
+
+typedef struct gbx_rect {
+    int x, y, w, h;
+} gbx_rect_t;
+
 struct gbx_context {
     memory_regions_t mem;
     cpu_registers_t reg;
@@ -90,7 +112,17 @@ struct gbx_context {
     uint8_t opcode1;
     uint8_t opcode2;
     uint16_t next_pc;
-    uint32_t fb[GBX_LCD_XRES * GBX_LCD_YRES];
+    uint32_t fb[GBX_FB_COUNT][GBX_FB_SIZE];
+    uint8_t *fb_base[GBX_FB_COUNT]; // internal or caller supplied storage
+    uint8_t *fb_draw;           // buffer currently being rendered into
+    int fb_pitch, fb_format;    // layout of the buffer being rendered into
+    gbx_frame_t fb_slot[GBX_FB_COUNT]; // frame held by each buffer
+    long frame_count;
+    int fb_back;                // owned by the emulator thread
+    int fb_ready;               // exchanged atomically, see FB_FRESH
+    int fb_front;               // owned by the display thread
+    long fb_last_seq;           // last frame acquired by the display thread
+    apu_t *apu;                 // sound generation, owned by the context
     void *userdata;
     FILE *serial_log;
 };
@@ -109,9 +141,33 @@ void gbx_set_serial_log(gbx_context_t *ctx, const char *path);
 void gbx_set_debugger(gbx_context_t *ctx, int enable);
 void gbx_set_input_state(gbx_context_t *ctx, int input, int pressed);
 
+// the functions below must be called from the thread executing the emulator,
+// or while it is stopped, except for gbx_acquire_frame, which belongs to one
+// display thread, and gbx_set_audio_synthesis, which any thread may call
+
+int  gbx_set_framebuffer_target(gbx_context_t *ctx, void *ptr, int pitch,
+                                int format);
+int  gbx_set_render_thread(gbx_context_t *ctx, int enable);
+int  gbx_set_color_profile(gbx_context_t *ctx, int profile, float gamma);
+int  gbx_set_frame_blend(gbx_context_t *ctx, int weight);
+int  gbx_acquire_frame(gbx_context_t *ctx, gbx_frame_t *frame);
+int  gbx_set_audio_rate(gbx_context_t *ctx, long sample_rate);
+void gbx_adjust_audio_clock(gbx_context_t *ctx, double ratio);
+int  gbx_set_audio_thread(gbx_context_t *ctx, int enable);
+int  gbx_set_audio_stems(gbx_context_t *ctx, int enable);
+void gbx_set_audio_synthesis(gbx_context_t *ctx, int enable);
+long gbx_audio_avail(gbx_context_t *ctx);
+long gbx_read_audio(gbx_context_t *ctx, int16_t *dest, long count);
+long gbx_read_audio_stems(gbx_context_t *ctx, int16_t *dest, long count);
 void gbx_get_framebuffer(gbx_context_t *ctx, uint32_t *dest);
+void gbx_expand_frame(gbx_context_t *ctx, const gbx_frame_t *frame,
+                      uint32_t *dest);
 void gbx_get_tile_buffer(gbx_context_t *ctx, uint32_t *dest, int index);
 void gbx_get_tmap_buffer(gbx_context_t *ctx, uint32_t *dest, int index);
+int  gbx_update_tile_buffer(gbx_context_t *ctx, uint32_t *dest, int index,
+                            int palette, gbx_rect_t *rects, int max_rects);
+int  gbx_update_tmap_buffer(gbx_context_t *ctx, uint32_t *dest, int index,
+                            gbx_rect_t *rects, int max_rects);
 long gbx_get_clock_frequency(gbx_context_t *ctx);
 long gbx_get_cycle_count(gbx_context_t *ctx);
 int  gbx_get_cart_features(gbx_context_t *ctx);
@@ -119,14 +175,32 @@ int  gbx_get_cart_features(gbx_context_t *ctx);
 int  gbx_disassemble_op(gbx_context_t *ctx, char *buffer, int size);
 void gbx_trace_instruction(gbx_context_t *ctx);
 
+// ----------------------------------------------------------------------------
+// Find the next run of changed rows, starting the search at *y. Returns the
+// number of rows in the run and sets *y to the first, or 0 if none are left.
+INLINE int gbx_next_dirty_rows(const gbx_frame_t *frame, int *y)
+{
+    int first = *y, last;
+
+    while (first < GBX_LCD_YRES &&
+           !(frame->dirty[first >> 5] & (1u << (first & 31))))
+        ++first;
+
+    last = first;
+    while (last < GBX_LCD_YRES &&
+           (frame->dirty[last >> 5] & (1u << (last & 31))))
+        ++last;
+
+    *y = first;
+    return last - first;
+}
+
 // interface to emulator frontend
 
 extern void ext_log_message(int level, const char *msg);
 extern void ext_video_sync(void *data);
 extern void ext_speed_change(void *data, int speed);
 extern void ext_lcd_enabled(void *data, int enabled);
-extern void ext_sound_write(void *data, uint16_t addr, uint8_t value);
-extern void ext_sound_read(void *data, uint16_t addr, uint8_t *value);
 extern void ext_sound_frame(void *data);
 
 #ifdef __cplusplus
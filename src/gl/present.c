@@ -0,0 +1,300 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "present.h"
+
+#define FENCE_TIMEOUT_NS    1000000000
+
+typedef struct vertex {
+    float x, y;
+    float s, t;
+} vertex_t;
+
+// ----------------------------------------------------------------------------
+int present_init(present_t *p, int width, int height)
+{
+    memset(p, 0, sizeof(present_t));
+    p->width = width;
+    p->height = height;
+
+    // set some reasonable defaults for rendering a 2d scene
+    glClearColor(0, 0, 0, 0);
+
+    glShadeModel(GL_FLAT);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_TEXTURE_2D);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    // create the render texture
+    glGenTextures(1, &p->texture);
+    glBindTexture(GL_TEXTURE_2D, p->texture);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+    glGenBuffers(1, &p->vbo);
+    present_set_scale(p, 1);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+    return GL_NO_ERROR == glGetError() ? 0 : -1;
+}
+
+// ----------------------------------------------------------------------------
+// Size the texture for images scale times the size of a frame, as made by the
+// pixel art filters, and point the quad at the part they cover. Frames can
+// only be uploaded at scale 1. The texture contents are lost.
+void present_set_scale(present_t *p, int scale)
+{
+    vertex_t quad[4];
+    float tu, tv;
+
+    p->scale = scale;
+    p->tex_dim = tex_pow2(p->width * scale, p->height * scale);
+
+    glBindTexture(GL_TEXTURE_2D, p->texture);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+            p->tex_dim, p->tex_dim, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    // the quad spans the unit square and only changes with the scale, the
+    // image is placed with the modelview matrix instead
+    tu = p->width * scale / (float)p->tex_dim;
+    tv = p->height * scale / (float)p->tex_dim;
+
+    quad[0].x = -1.0f; quad[0].y = -1.0f; quad[0].s = 0.0f; quad[0].t = tv;
+    quad[1].x =  1.0f; quad[1].y = -1.0f; quad[1].s = tu;   quad[1].t = tv;
+    quad[2].x = -1.0f; quad[2].y =  1.0f; quad[2].s = 0.0f; quad[2].t = 0.0f;
+    quad[3].x =  1.0f; quad[3].y =  1.0f; quad[3].s = tu;   quad[3].t = 0.0f;
+
+    glBindBuffer(GL_ARRAY_BUFFER, p->vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// ----------------------------------------------------------------------------
+// Create a ring of pixel buffers for the given number of frames and map it for
+// the lifetime of the context, so the emulator can render straight into memory
+// the driver uploads from. Returns NULL if persistent mapping is unsupported,
+// or if there are no fences to tell when the gpu is done reading a frame.
+void *present_map_target(present_t *p, int frames, int *pitch)
+{
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                       GL_MAP_COHERENT_BIT;
+
+    *pitch = p->width * 4;
+    if (p->pbo_map || !GLEW_ARB_buffer_storage || !GLEW_ARB_sync)
+        return p->pbo_map;
+
+    p->pbo_sz = frames * p->height * *pitch;
+    glGenBuffers(1, &p->pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, p->pbo);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, p->pbo_sz, NULL, flags);
+    p->pbo_map = (uint8_t *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+            p->pbo_sz, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (NULL == p->pbo_map) {
+        glDeleteBuffers(1, &p->pbo);
+        p->pbo = 0;
+        p->pbo_sz = 0;
+    }
+
+    return p->pbo_map;
+}
+
+// ----------------------------------------------------------------------------
+// Position the image within the viewport, in normalized device coordinates.
+void present_place(present_t *p, float x0, float y0, float x1, float y1)
+{
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glTranslatef((x0 + x1) * 0.5f, (y0 + y1) * 0.5f, 0.0f);
+    glScalef((x1 - x0) * 0.5f, (y1 - y0) * 0.5f, 1.0f);
+}
+
+// ----------------------------------------------------------------------------
+void present_set_filter(present_t *p, int linear)
+{
+    GLint filter = linear ? GL_LINEAR : GL_NEAREST;
+
+    glBindTexture(GL_TEXTURE_2D, p->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+}
+
+// ----------------------------------------------------------------------------
+// Upload rows [y, y + rows) of an image to the texture. Returns 1 if they were
+// sourced from the mapped ring, 0 if they came from client memory.
+static int upload_rows(present_t *p, const uint8_t *src, int pitch,
+                       int y, int rows)
+{
+    int ring = 0;
+    src += y * pitch;
+
+    // frames rendered into the mapped ring are sourced by offset from it, and
+    // anything else is uploaded directly from client memory
+    if (p->pbo_map && src >= p->pbo_map && src < p->pbo_map + p->pbo_sz) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, p->pbo);
+        src = (const uint8_t *)(size_t)(src - p->pbo_map);
+        ring = 1;
+    }
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch / 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, p->width, rows,
+            GL_RGBA, GL_UNSIGNED_BYTE, src);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return ring;
+}
+
+// ----------------------------------------------------------------------------
+// Upload the rows of a frame that changed since the last one. Returns the
+// number of rows uploaded, so the caller can skip presenting an unchanged
+// frame.
+int present_upload(present_t *p, const gbx_frame_t *frame)
+{
+    const uint8_t *src = (const uint8_t *)frame->pixels;
+    int y = 0, rows, ring = 0, changed = 0;
+
+    glBindTexture(GL_TEXTURE_2D, p->texture);
+    while (0 != (rows = gbx_next_dirty_rows(frame, &y))) {
+        ring |= upload_rows(p, src, frame->pitch, y, rows);
+        changed += rows;
+        y += rows;
+    }
+
+    // the emulator gets this part of the ring back on the next acquire, so
+    // mark the point where the gpu is done reading from it
+    if (ring) {
+        if (p->fence)
+            glDeleteSync(p->fence);
+        p->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    return changed;
+}
+
+// ----------------------------------------------------------------------------
+// Upload a whole, tightly packed image at the current scale from client memory.
+void present_upload_image(present_t *p, const uint32_t *src)
+{
+    int width = p->width * p->scale;
+
+    glBindTexture(GL_TEXTURE_2D, p->texture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, p->height * p->scale,
+            GL_RGBA, GL_UNSIGNED_BYTE, src);
+}
+
+// ----------------------------------------------------------------------------
+// Read the image at scale 1 back from the texture, for the rare times it is
+// needed in client memory again. This stalls until the gpu catches up.
+void present_read(present_t *p, uint32_t *dest)
+{
+    uint32_t *tex = (uint32_t *)malloc(p->tex_dim * p->tex_dim * 4);
+    int y;
+
+    if (NULL == tex)
+        return;
+
+    glBindTexture(GL_TEXTURE_2D, p->texture);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, tex);
+    for (y = 0; y < p->height; y++)
+        memcpy(&dest[y * p->width], &tex[y * p->tex_dim], p->width * 4);
+    free(tex);
+}
+
+// ----------------------------------------------------------------------------
+void present_clear(present_t *p, uint8_t value)
+{
+    int size = p->width * p->scale * p->height * p->scale * 4;
+    uint32_t *blank = (uint32_t *)malloc(size);
+
+    if (NULL == blank)
+        return;
+
+    memset(blank, value, size);
+    present_upload_image(p, blank);
+    free(blank);
+}
+
+// ----------------------------------------------------------------------------
+// Block until the gpu has finished reading the last frame uploaded from the
+// ring. Call this before acquiring the next frame, which hands that memory
+// back to the emulator. Normally the fence was passed long ago.
+void present_wait(present_t *p)
+{
+    GLenum rc;
+
+    if (!p->fence)
+        return;
+
+    do {
+        rc = glClientWaitSync(p->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                FENCE_TIMEOUT_NS);
+    } while (GL_TIMEOUT_EXPIRED == rc);
+
+    glDeleteSync(p->fence);
+    p->fence = 0;
+}
+
+// ----------------------------------------------------------------------------
+void present_draw(present_t *p)
+{
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glBindTexture(GL_TEXTURE_2D, p->texture);
+    glBindBuffer(GL_ARRAY_BUFFER, p->vbo);
+    glVertexPointer(2, GL_FLOAT, sizeof(vertex_t),
+            (const GLvoid *)offsetof(vertex_t, x));
+    glTexCoordPointer(2, GL_FLOAT, sizeof(vertex_t),
+            (const GLvoid *)offsetof(vertex_t, s));
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// ----------------------------------------------------------------------------
+void present_shutdown(present_t *p)
+{
+    if (p->fence)
+        glDeleteSync(p->fence);
+
+    if (p->pbo_map) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, p->pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    glDeleteBuffers(1, &p->vbo);
+    glDeleteBuffers(1, &p->pbo);
+    glDeleteTextures(1, &p->texture);
+    memset(p, 0, sizeof(present_t));
+}
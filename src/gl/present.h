@@ -0,0 +1,77 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef GBOY_PRESENT__H
+#define GBOY_PRESENT__H
+
+#include <GL/glew.h>
+#include "common.h"
+#include "gbx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// OpenGL presentation of emulator frames, shared by the frontends. Frames are
+// rendered into a ring of persistently mapped pixel buffers when the driver
+// supports it, only the rows that changed are uploaded to the texture, and a
+// fence keeps a buffer from being handed back to the emulator before the gpu
+// is done reading it. The quad lives in a static vbo and is placed in the
+// viewport through the modelview matrix. Frontends that filter frames on the
+// cpu upload whole images of a larger scale instead.
+typedef struct present {
+    GLuint texture, vbo, pbo;
+    GLsync fence;               // last upload sourced from the ring, if any
+    uint8_t *pbo_map;           // persistent mapping of the ring, if any
+    int pbo_sz, tex_dim;
+    int width, height;
+    int scale;                  // size of the image as a multiple of a frame
+} present_t;
+
+int present_init(present_t *p, int width, int height);
+void *present_map_target(present_t *p, int frames, int *pitch);
+void present_place(present_t *p, float x0, float y0, float x1, float y1);
+void present_set_filter(present_t *p, int linear);
+void present_set_scale(present_t *p, int scale);
+int present_upload(present_t *p, const gbx_frame_t *frame);
+void present_upload_image(present_t *p, const uint32_t *src);
+void present_read(present_t *p, uint32_t *dest);
+void present_clear(present_t *p, uint8_t value);
+void present_wait(present_t *p);
+void present_draw(present_t *p);
+void present_shutdown(present_t *p);
+
+// ----------------------------------------------------------------------------
+// Return the nearest square, pow2 texture dimension >= MAX(width, height).
+INLINE unsigned int tex_pow2(unsigned int width, unsigned int height)
+{
+    unsigned int input = MAX(width, height);
+    unsigned int value = 2;
+
+    if (0 == (input & (input - 1)))
+        return input;
+
+    while (0 != (input >>= 1))
+        value <<= 1;
+    return value;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GBOY_PRESENT__H
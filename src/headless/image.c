@@ -0,0 +1,202 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "image.h"
+
+// stored deflate blocks hold at most this many bytes
+#define PNG_BLOCK_MAX   65535
+
+static uint32_t crc_table[256];
+
+// ----------------------------------------------------------------------------
+static void crc_init(void)
+{
+    uint32_t c;
+    int n, k;
+
+    for (n = 0; n < 256; n++) {
+        c = (uint32_t)n;
+        for (k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+// ----------------------------------------------------------------------------
+static uint32_t crc_update(uint32_t crc, const uint8_t *buf, int len)
+{
+    while (len--)
+        crc = crc_table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+// ----------------------------------------------------------------------------
+INLINE void put_be32(uint8_t *buf, uint32_t value)
+{
+    buf[0] = (uint8_t)(value >> 24);
+    buf[1] = (uint8_t)(value >> 16);
+    buf[2] = (uint8_t)(value >> 8);
+    buf[3] = (uint8_t)value;
+}
+
+// ----------------------------------------------------------------------------
+// Pick the image format from the file extension, defaulting to raw pixels.
+int image_format_from_path(const char *path)
+{
+    const char *ext = strrchr(path, '.');
+
+    if (ext && !strcmp(ext, ".ppm"))
+        return IMAGE_PPM;
+    if (ext && !strcmp(ext, ".png"))
+        return IMAGE_PNG;
+    return IMAGE_RAW;
+}
+
+// ----------------------------------------------------------------------------
+static int write_raw(FILE *fp, const uint8_t *pixels,
+                     int width, int height, int pitch)
+{
+    int y;
+
+    for (y = 0; y < height; y++, pixels += pitch) {
+        if (1 != fwrite(pixels, width * 3, 1, fp))
+            return -1;
+    }
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int write_ppm(FILE *fp, const uint8_t *pixels,
+                     int width, int height, int pitch)
+{
+    if (0 > fprintf(fp, "P6\n%d %d\n255\n", width, height))
+        return -1;
+    return write_raw(fp, pixels, width, height, pitch);
+}
+
+// ----------------------------------------------------------------------------
+static int write_png_chunk(FILE *fp, const char *type,
+                           const uint8_t *data, int len)
+{
+    uint8_t header[8], footer[4];
+    uint32_t crc;
+
+    put_be32(header, (uint32_t)len);
+    memcpy(&header[4], type, 4);
+
+    crc = crc_update(0xFFFFFFFF, &header[4], 4);
+    crc = crc_update(crc, data, len);
+    put_be32(footer, crc ^ 0xFFFFFFFF);
+
+    if (1 != fwrite(header, sizeof(header), 1, fp))
+        return -1;
+    if (len && 1 != fwrite(data, len, 1, fp))
+        return -1;
+    if (1 != fwrite(footer, sizeof(footer), 1, fp))
+        return -1;
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Write a png without compression, so no zlib is needed. The image data is a
+// zlib stream of stored deflate blocks, each row prefixed by filter type 0.
+static int write_png(FILE *fp, const uint8_t *pixels,
+                     int width, int height, int pitch)
+{
+    static const uint8_t signature[8] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'
+    };
+    uint8_t ihdr[13], *idat, *dst;
+    int row_size = width * 3 + 1;
+    int raw_size = row_size * height;
+    int blocks = (raw_size + PNG_BLOCK_MAX - 1) / PNG_BLOCK_MAX;
+    int idat_size = 2 + blocks * 5 + raw_size + 4;
+    uint32_t s1 = 1, s2 = 0;
+    int x, y, pos, len, rc;
+
+    if (0 == crc_table[1])
+        crc_init();
+
+    put_be32(&ihdr[0], (uint32_t)width);
+    put_be32(&ihdr[4], (uint32_t)height);
+    ihdr[8] = 8;    // bit depth
+    ihdr[9] = 2;    // truecolor
+    ihdr[10] = 0;   // deflate
+    ihdr[11] = 0;   // adaptive filtering
+    ihdr[12] = 0;   // no interlace
+
+    if (NULL == (idat = (uint8_t *)malloc(idat_size + raw_size)))
+        return -1;
+
+    // gather the filtered rows at the end of the buffer, updating the adler32
+    // checksum as each byte is produced
+    dst = idat + idat_size;
+    for (y = 0; y < height; y++, pixels += pitch) {
+        *dst++ = 0;
+        memcpy(dst, pixels, width * 3);
+        dst += width * 3;
+    }
+    for (x = 0; x < raw_size; x++) {
+        s1 = (s1 + idat[idat_size + x]) % 65521;
+        s2 = (s2 + s1) % 65521;
+    }
+
+    // then split them into stored blocks behind the zlib header
+    dst = idat;
+    *dst++ = 0x78;
+    *dst++ = 0x01;
+    for (pos = 0; pos < raw_size; pos += len) {
+        len = MIN(raw_size - pos, PNG_BLOCK_MAX);
+        *dst++ = (pos + len == raw_size) ? 1 : 0;
+        *dst++ = (uint8_t)len;
+        *dst++ = (uint8_t)(len >> 8);
+        *dst++ = (uint8_t)~len;
+        *dst++ = (uint8_t)((len >> 8) ^ 0xFF);
+        memmove(dst, idat + idat_size + pos, len);
+        dst += len;
+    }
+    put_be32(dst, (s2 << 16) | s1);
+
+    rc = -1;
+    if (1 == fwrite(signature, sizeof(signature), 1, fp) &&
+        0 == write_png_chunk(fp, "IHDR", ihdr, sizeof(ihdr)) &&
+        0 == write_png_chunk(fp, "IDAT", idat, idat_size) &&
+        0 == write_png_chunk(fp, "IEND", NULL, 0))
+        rc = 0;
+
+    free(idat);
+    return rc;
+}
+
+// ----------------------------------------------------------------------------
+// Write an image of packed 24-bit RGB pixels in the given format. Returns 0 on
+// success, -1 if the stream could not be written.
+int image_write(FILE *fp, int format, const uint8_t *pixels,
+                int width, int height, int pitch)
+{
+    switch (format) {
+    case IMAGE_PPM:
+        return write_ppm(fp, pixels, width, height, pitch);
+    case IMAGE_PNG:
+        return write_png(fp, pixels, width, height, pitch);
+    default:
+        return write_raw(fp, pixels, width, height, pitch);
+    }
+}
@@ -0,0 +1,33 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+#ifndef GBOY_IMAGE__H
+#define GBOY_IMAGE__H
+
+#include <stdio.h>
+#include "common.h"
+
+#define IMAGE_RAW       0   // rows of packed 24-bit RGB, nothing else
+#define IMAGE_PPM       1   // binary portable pixmap (P6)
+#define IMAGE_PNG       2   // uncompressed truecolor png
+
+int image_format_from_path(const char *path);
+int image_write(FILE *fp, int format, const uint8_t *pixels,
+                int width, int height, int pitch);
+
+#endif // GBOY_IMAGE__H
@@ -0,0 +1,293 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include "cmdline.h"
+#include "gbx.h"
+#include "image.h"
+#include "recorder.h"
+#include "wave.h"
+
+#ifdef PLATFORM_WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#define AUDIO_RATE      44100   // output rate of the audio files, in Hz
+#define AUDIO_CHUNK     1024    // stereo sample pairs read at a time
+
+typedef struct headless {
+    gbx_context_t *ctx;         // gbx emulator context
+    wave_t *wav;                // every sample produced, if any
+    wave_t *pcm;                // the same samples without a header, if any
+    wave_t *stems;              // every oscillator on its own, if any
+    int16_t samples[AUDIO_CHUNK * APU_STEMS]; // sound on its way to the files
+    int fast_mode;              // running at CGB double speed
+    char *frame_path;           // output file, or pattern with a frame number
+    int frame_format;           // one of IMAGE_*
+    int frame_split;            // each frame goes to its own file
+    FILE *frame_fp;             // single output stream for every frame
+    recorder_t *rec;            // video stream of every frame, if any
+} headless_t;
+
+static volatile sig_atomic_t running = 1;
+
+// ----------------------------------------------------------------------------
+static void handle_signal(int sig)
+{
+    // stop at the end of the current frame so the outputs are left complete
+    running = 0;
+}
+
+// ----------------------------------------------------------------------------
+// Everything is logged to standard error, which keeps standard output free
+// for frames or audio written to a pipe.
+void ext_log_message(int level, const char *msg)
+{
+    fputs(msg, stderr);
+}
+
+// ----------------------------------------------------------------------------
+// Frames are collected once per frame period by the main loop instead.
+void ext_video_sync(void *data)
+{
+}
+
+// ----------------------------------------------------------------------------
+void ext_speed_change(void *data, int speed)
+{
+    headless_t *hl = (headless_t *)data;
+    hl->fast_mode = speed;
+}
+
+// ----------------------------------------------------------------------------
+void ext_lcd_enabled(void *data, int enabled)
+{
+}
+
+// ----------------------------------------------------------------------------
+// Append every sample of the sound frame to the audio files. There is no
+// real-time playback to keep up with, so nothing is ever dropped, and the
+// output depends on nothing but the emulated cycles.
+void ext_sound_frame(void *data)
+{
+    headless_t *hl = (headless_t *)data;
+    long count;
+
+    while (0 != (count = gbx_read_audio(hl->ctx, hl->samples, AUDIO_CHUNK))) {
+        if (hl->wav)
+            wave_write(hl->wav, hl->samples, count);
+        if (hl->pcm)
+            wave_write(hl->pcm, hl->samples, count);
+    }
+
+    if (!hl->stems)
+        return;
+
+    while (0 != (count = gbx_read_audio_stems(hl->ctx, hl->samples,
+                                              AUDIO_CHUNK)))
+        wave_write(hl->stems, hl->samples, count);
+}
+
+// ----------------------------------------------------------------------------
+// Prepare to write frames to path. A path containing a printf conversion such
+// as "shot%05d.png" names one file per frame, anything else is a single stream
+// every frame is appended to ("-" for standard output).
+static int open_frame_output(headless_t *hl, const char *path)
+{
+    hl->frame_path = strdup(path);
+    hl->frame_format = image_format_from_path(path);
+    hl->frame_split = (NULL != strchr(path, '%'));
+
+    if (hl->frame_split)
+        return 0;
+
+    if (!strcmp(path, "-")) {
+#ifdef PLATFORM_WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        hl->frame_fp = stdout;
+    }
+    else if (NULL == (hl->frame_fp = fopen(path, "wb"))) {
+        log_err("Failed to open '%s' for writing frames.\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+static void close_frame_output(headless_t *hl)
+{
+    if (hl->frame_fp && hl->frame_fp != stdout)
+        fclose(hl->frame_fp);
+    else if (hl->frame_fp)
+        fflush(stdout);
+
+    SAFE_FREE(hl->frame_path);
+}
+
+// ----------------------------------------------------------------------------
+static int write_frame(headless_t *hl, const gbx_frame_t *frame, int index)
+{
+    char name[1024];
+    FILE *fp = hl->frame_fp;
+    int rc;
+
+    if (hl->frame_split) {
+        snprintf(name, sizeof(name), hl->frame_path, index);
+        if (NULL == (fp = fopen(name, "wb"))) {
+            log_err("Failed to open '%s' for writing frames.\n", name);
+            return -1;
+        }
+    }
+
+    rc = image_write(fp, hl->frame_format, (const uint8_t *)frame->pixels,
+                     GBX_LCD_XRES, GBX_LCD_YRES, frame->pitch);
+    if (rc)
+        log_err("Failed to write frame %d.\n", index);
+
+    if (hl->frame_split)
+        fclose(fp);
+    return rc;
+}
+
+// ----------------------------------------------------------------------------
+// Run the emulator as fast as the host allows, one frame period at a time,
+// until the requested number of frames is done or the process is signalled.
+// The latest frame is output after each period. If the core hasn't published
+// a new one, as when the LCD is off, the previous frame is still held and is
+// repeated, so the output keeps a steady rate of one image per period. The
+// processor time spent is reported, to compare the cost of the outputs.
+static void run_headless(headless_t *hl, int frames)
+{
+    gbx_frame_t frame;
+    clock_t start = clock();
+    double secs;
+    int index;
+
+    for (index = 0; running && (0 == frames || index < frames); index++) {
+        gbx_execute_cycles(hl->ctx, VIDEO_CYCLES_TOTAL << hl->fast_mode);
+        gbx_acquire_frame(hl->ctx, &frame);
+
+        // there is no display to keep up with, so wait for the writer
+        if (hl->rec)
+            recorder_push(hl->rec, &frame, 1);
+
+        if (hl->frame_path && write_frame(hl, &frame, index))
+            break;
+    }
+
+    secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+    log_info("Emulated %d frames in %.2f s of cpu time (%.0f fps).\n",
+             index, secs, secs > 0 ? index / secs : 0.0);
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    cmdargs_t ca;
+    headless_t hl = {0};
+    int rc = EXIT_FAILURE;
+
+    // process and validate the command line arguments
+    if (cmdline_parse(argc, argv, &ca, CMDLINE_FE_HEADLESS)) {
+        cmdline_display_usage(CMDLINE_FE_HEADLESS);
+    }
+
+    // create an emulator context for the given system type (default AUTO)
+    if (gbx_create_context(&hl.ctx, ca.system)) {
+        log_err("Failed to create gbx context.\n");
+        goto error_cleanup;
+    }
+
+    // set the bios location (if provided) and attempt to load the ROM file
+    if (ca.bios_path)
+        gbx_set_bios_dir(hl.ctx, ca.bios_path);
+
+    if (gbx_load_file(hl.ctx, ca.rom_path)) {
+        log_err("Failed to load image \"%s\".\n", ca.rom_path);
+        goto error_cleanup;
+    }
+
+    gbx_set_userdata(hl.ctx, &hl);
+    gbx_set_debugger(hl.ctx, ca.debugger);
+
+    if (ca.serial_path)
+        gbx_set_serial_log(hl.ctx, ca.serial_path);
+
+    gbx_set_color_profile(hl.ctx, ca.color_profile, ca.color_gamma);
+
+    if (ca.ghosting && gbx_set_frame_blend(hl.ctx, ca.ghosting))
+        log_err("failed to enable frame blending\n");
+
+    // every output format is built from packed 24-bit RGB rows
+    gbx_set_framebuffer_target(hl.ctx, NULL, 0, GBX_PIXEL_RGB888);
+    if (ca.frame_path && open_frame_output(&hl, ca.frame_path))
+        goto error_cleanup;
+
+    if (ca.record_path) {
+        hl.rec = recorder_open(ca.record_path,
+                               recorder_format_from_path(ca.record_path));
+        if (NULL == hl.rec)
+            goto error_cleanup;
+    }
+
+    // without an audio file, only the sound registers need to be emulated.
+    // the rate is fixed and never steered, so samples only depend on cycles
+    gbx_set_audio_synthesis(hl.ctx, ca.wav_path || ca.pcm_path);
+    gbx_set_audio_rate(hl.ctx, AUDIO_RATE);
+    if (ca.wav_path) {
+        hl.wav = wave_open(ca.wav_path, AUDIO_RATE, WAVE_RIFF, 2);
+        if (NULL == hl.wav)
+            goto error_cleanup;
+    }
+    if (ca.pcm_path) {
+        hl.pcm = wave_open(ca.pcm_path, AUDIO_RATE, WAVE_RAW, 2);
+        if (NULL == hl.pcm)
+            goto error_cleanup;
+    }
+    if (ca.stems_path) {
+        hl.stems = wave_open(ca.stems_path, AUDIO_RATE,
+                             wave_format_from_path(ca.stems_path), APU_STEMS);
+        if (NULL == hl.stems || gbx_set_audio_stems(hl.ctx, 1))
+            goto error_cleanup;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    gbx_power_on(hl.ctx);
+    run_headless(&hl, ca.frames);
+    rc = EXIT_SUCCESS;
+
+error_cleanup:
+    if (hl.ctx)
+        gbx_destroy_context(hl.ctx);
+    recorder_close(hl.rec);
+    wave_close(hl.wav);
+    wave_close(hl.pcm);
+    wave_close(hl.stems);
+    close_frame_output(&hl);
+    cmdline_destroy(&ca);
+    return rc;
+}
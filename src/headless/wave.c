@@ -0,0 +1,165 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gbx.h"
+#include "wave.h"
+
+#ifdef PLATFORM_WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#define WAV_HEADER_SIZE 44
+#define WAV_CHUNK       2048    // samples converted at a time
+
+struct wave {
+    int sample_rate;
+    int format;                 // one of WAVE_*
+    int channels;               // samples per frame
+    FILE *fp;
+    uint32_t data_size;         // bytes of samples written so far
+    int seekable;               // header can be patched when closing
+    uint8_t bytes[WAV_CHUNK * 2];
+};
+
+// ----------------------------------------------------------------------------
+INLINE void put_le16(uint8_t *buf, uint16_t value)
+{
+    buf[0] = (uint8_t)value;
+    buf[1] = (uint8_t)(value >> 8);
+}
+
+// ----------------------------------------------------------------------------
+INLINE void put_le32(uint8_t *buf, uint32_t value)
+{
+    put_le16(&buf[0], (uint16_t)value);
+    put_le16(&buf[2], (uint16_t)(value >> 16));
+}
+
+// ----------------------------------------------------------------------------
+// Write a 16-bit PCM header for data_size bytes of samples. Streams
+// that can't be rewound keep the maximum size, which players read as unknown.
+static int write_header(wave_t *wav, uint32_t data_size)
+{
+    uint8_t hdr[WAV_HEADER_SIZE];
+
+    memcpy(&hdr[0], "RIFF", 4);
+    put_le32(&hdr[4], data_size + WAV_HEADER_SIZE - 8);
+    memcpy(&hdr[8], "WAVE", 4);
+    memcpy(&hdr[12], "fmt ", 4);
+    put_le32(&hdr[16], 16);
+    put_le16(&hdr[20], 1);                          // PCM
+    put_le16(&hdr[22], wav->channels);
+    put_le32(&hdr[24], wav->sample_rate);
+    put_le32(&hdr[28], wav->sample_rate * wav->channels * 2);
+    put_le16(&hdr[32], wav->channels * 2);          // bytes per frame
+    put_le16(&hdr[34], 16);                         // bits per sample
+    memcpy(&hdr[36], "data", 4);
+    put_le32(&hdr[40], data_size);
+
+    return (1 == fwrite(hdr, sizeof(hdr), 1, wav->fp)) ? 0 : -1;
+}
+
+// ----------------------------------------------------------------------------
+int wave_format_from_path(const char *path)
+{
+    const char *ext = strrchr(path, '.');
+    return (ext && !strcmp(ext, ".wav")) ? WAVE_RIFF : WAVE_RAW;
+}
+
+// ----------------------------------------------------------------------------
+// Create a WAV or raw PCM file at path, or write to standard output if path
+// is "-".
+wave_t *wave_open(const char *path, int sample_rate, int format,
+                  int channels)
+{
+    wave_t *wav = (wave_t *)calloc(1, sizeof(wave_t));
+    wav->sample_rate = sample_rate;
+    wav->format = format;
+    wav->channels = channels;
+
+    if (!strcmp(path, "-")) {
+#ifdef PLATFORM_WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        wav->fp = stdout;
+    }
+    else
+        wav->fp = fopen(path, "wb");
+
+    if (NULL == wav->fp) {
+        log_err("Failed to open '%s' for writing audio.\n", path);
+        wave_close(wav);
+        return NULL;
+    }
+
+    if (WAVE_RAW == format)
+        return wav;
+
+    // pipes and terminals fail to seek, so their header is never patched
+    wav->seekable = (0 == fseek(wav->fp, 0, SEEK_CUR));
+    if (write_header(wav, wav->seekable ? 0 : 0xFFFFFFFF - 36)) {
+        log_err("Failed to write WAV header.\n");
+        wave_close(wav);
+        return NULL;
+    }
+
+    return wav;
+}
+
+// ----------------------------------------------------------------------------
+// Append count frames, each holding one sample of every channel in turn.
+int wave_write(wave_t *wav, const int16_t *samples, long count)
+{
+    long i, n;
+
+    for (count *= wav->channels; count > 0; count -= n, samples += n) {
+        n = MIN(count, WAV_CHUNK);
+        for (i = 0; i < n; i++)
+            put_le16(&wav->bytes[i * 2], (uint16_t)samples[i]);
+
+        if (1 != fwrite(wav->bytes, n * 2, 1, wav->fp)) {
+            log_err("Failed to write audio samples.\n");
+            return -1;
+        }
+        wav->data_size += n * 2;
+    }
+
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+void wave_close(wave_t *wav)
+{
+    if (!wav)
+        return;
+
+    if (wav->fp) {
+        // now that the length is known, fill it in if the stream allows
+        if (wav->seekable && 0 == fseek(wav->fp, 0, SEEK_SET))
+            write_header(wav, wav->data_size);
+        if (wav->fp != stdout)
+            fclose(wav->fp);
+        else
+            fflush(stdout);
+    }
+
+    SAFE_FREE(wav);
+}
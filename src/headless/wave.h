@@ -0,0 +1,36 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef GBOY_WAVE__H
+#define GBOY_WAVE__H
+
+#include "common.h"
+
+// 16-bit PCM written to a WAV file or stream
+
+#define WAVE_RIFF       0   // WAV file with a RIFF header
+#define WAVE_RAW        1   // interleaved little endian samples, nothing else
+
+typedef struct wave wave_t;
+
+int     wave_format_from_path(const char *path);
+wave_t *wave_open(const char *path, int sample_rate, int format,
+                  int channels);
+int     wave_write(wave_t *wav, const int16_t *samples, long count);
+void    wave_close(wave_t *wav);
+
+#endif // GBOY_WAVE__H
@@ -1064,8 +1064,9 @@ static void perform_cyclic_tasks(gbx_context_t *ctx)
     ctx->cycles += ctx->cycle_delta;
     ctx->frame_cycles += ctx->cycle_delta;
 
-    while (ctx->frame_cycles >= (20000 * 8)) {
-        ctx->frame_cycles -= (20000 * 8);
+    while (ctx->frame_cycles >= SOUND_FRAME_CYCLES) {
+        ctx->frame_cycles -= SOUND_FRAME_CYCLES;
+        apu_end_frame(ctx->apu, SOUND_FRAME_CYCLES);
         ext_sound_frame(ctx->userdata);
     }
 
@@ -1098,6 +1099,8 @@ static int process_stop_state(gbx_context_t *ctx)
         ctx->exec_flags &= ~EXEC_STOP;
         ctx->key1 = (ctx->key1 ^ KEY1_SPEED) & ~KEY1_PREP;
         ctx->fast_mode = (ctx->key1 & KEY1_SPEED) ? 1 : 0;
+        apu_set_clock_rate(ctx->apu,
+                           ctx->fast_mode ? CPU_FREQ_CGB : CPU_FREQ_DMG);
         ext_speed_change(ctx->userdata, ctx->fast_mode);
         return 0;
     }
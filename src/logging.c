@@ -17,7 +17,7 @@
 
 #include "gbx.h"
 
-#define LOG_MAX 1024
+#define LOG_MAX 4096    // fits the whole usage message
 
 // ----------------------------------------------------------------------------
 void log_vprintf(int level, const char *fmt, va_list arg)
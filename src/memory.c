@@ -92,6 +92,8 @@ uint8_t mmu_rd_vram_bank(gbx_context_t *ctx, uint16_t addr)
 // ----------------------------------------------------------------------------
 void mmu_wr_vram_bank(gbx_context_t *ctx, uint16_t addr, uint8_t value)
 {
+    int offset;
+
 #ifdef PROTECT_VRAM_ACCESS
     if (!is_vram_accessible(ctx)) {
         log_warn("attempted to write VRAM when in use by LCD controller\n");
@@ -100,7 +102,10 @@ void mmu_wr_vram_bank(gbx_context_t *ctx, uint16_t addr, uint8_t value)
 #endif
 
     log_spew("mmu_wr_vram_bank: addr=%04X value=%02X\n", addr, value);
-    ctx->mem.vram_bank[addr & VRAM_MASK] = value;
+    offset = ctx->mem.vram_bank - ctx->mem.vram + (addr & VRAM_MASK);
+    ctx->mem.vram[offset] = value;
+    video_mark_vram(&ctx->video, offset);
+    video_journal_write(ctx, VIDEO_WRITE_VRAM, offset, value);
 }
 
 // ----------------------------------------------------------------------------
@@ -168,7 +173,11 @@ void mmu_wr_oam(gbx_context_t *ctx, uint16_t addr, uint8_t value)
 #endif
 
     log_spew("mmu_wr_oam: addr=%04X value=%02X\n", addr, value);
-    ctx->mem.oam[addr & 0xFF] = value;
+    if (ctx->mem.oam[addr & 0xFF] != value) {
+        // the renderer replays the write, rebuilding its sprite index
+        ctx->mem.oam[addr & 0xFF] = value;
+        video_journal_write(ctx, VIDEO_WRITE_OAM, addr & 0xFF, value);
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -369,7 +378,7 @@ static uint8_t mmu_rd_himem(gbx_context_t *ctx, uint16_t addr)
     case PORT_NR51:
     case PORT_NR52:
     case PORT_NR_UNK:
-        ext_sound_read(ctx->userdata, addr, &value);
+        value = apu_read(ctx->apu, ctx->frame_cycles, addr);
         break;
     case PORT_BIOS:
         value = ctx->bios_enabled;
@@ -437,9 +446,11 @@ static void mmu_wr_himem(gbx_context_t *ctx, uint16_t addr, uint8_t value)
         break;
     case PORT_SCY:
         ctx->video.scy = value;
+        video_journal_write(ctx, VIDEO_WRITE_PORT, offset, value);
         break;
     case PORT_SCX:
         ctx->video.scx = value;
+        video_journal_write(ctx, VIDEO_WRITE_PORT, offset, value);
         break;
     case PORT_LY:
         log_warn("attempting to write read-only PORT_LY (%02X)\n", value);
@@ -452,21 +463,26 @@ static void mmu_wr_himem(gbx_context_t *ctx, uint16_t addr, uint8_t value)
         break;
     case PORT_BGP:
         ctx->video.bgp = value;
-        video_write_mono_palette(ctx->video.bgp_rgb, value);
+        video_write_mono_palette(ctx->video.bgp_rgb, value, ctx->fb_format);
+        video_journal_write(ctx, VIDEO_WRITE_PORT, offset, value);
         break;
     case PORT_OBP0:
         ctx->video.obp0 = value;
-        video_write_mono_palette(ctx->video.obp0_rgb, value);
+        video_write_mono_palette(ctx->video.obp0_rgb, value, ctx->fb_format);
+        video_journal_write(ctx, VIDEO_WRITE_PORT, offset, value);
         break;
     case PORT_OBP1:
         ctx->video.obp1 = value;
-        video_write_mono_palette(ctx->video.obp1_rgb, value);
+        video_write_mono_palette(ctx->video.obp1_rgb, value, ctx->fb_format);
+        video_journal_write(ctx, VIDEO_WRITE_PORT, offset, value);
         break;
     case PORT_WY:
         ctx->video.wy = value;
+        video_journal_write(ctx, VIDEO_WRITE_PORT, offset, value);
         break;
     case PORT_WX:
         ctx->video.wx = value - 7;
+        video_journal_write(ctx, VIDEO_WRITE_PORT, offset, value);
         break;
     case PORT_KEY1:
         // only prep bit is writeable, mask out read-only / unused bits
@@ -538,7 +554,7 @@ static void mmu_wr_himem(gbx_context_t *ctx, uint16_t addr, uint8_t value)
     case PORT_NR51:
     case PORT_NR52:
     case PORT_NR_UNK:
-        ext_sound_write(ctx->userdata, addr, value);
+        apu_write(ctx->apu, ctx->frame_cycles, addr, value);
         break;
     case PORT_BIOS:
         if (ctx->bios_enabled) {
@@ -548,6 +564,7 @@ static void mmu_wr_himem(gbx_context_t *ctx, uint16_t addr, uint8_t value)
 
             // if running monochrome game on CGB, disable color post-bios
             ctx->color_enabled = ctx->color_game;
+            video_journal_write(ctx, VIDEO_WRITE_COLOR, 0, ctx->color_enabled);
         }
         break;
     default:
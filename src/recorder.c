@@ -0,0 +1,308 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "recorder.h"
+#include "thread.h"
+
+#ifdef PLATFORM_WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+// the frame rate of the LCD, 4194304 / 70224 ~= 59.73 Hz
+#define Y4M_HEADER  "YUV4MPEG2 W%d H%d F4194304:70224 Ip A1:1 C444\n"
+
+#define SLOT_BYTES  (GBX_LCD_XRES * GBX_LCD_YRES * 4)
+
+typedef struct record_slot {
+    uint8_t pixels[SLOT_BYTES]; // rows copied as is, in the frame's format
+    int format;
+    long seq, cycles;
+} record_slot_t;
+
+struct recorder {
+    FILE *fp;
+    int format;
+    thread_t thread;
+    mutex_t lock;
+    cond_t cond;                // signaled when a slot is filled or emptied
+    record_slot_t slots[RECORD_QUEUE];
+    int head, count;            // oldest queued slot and number queued
+    int quit, failed;
+    long last_seq;              // sequence number of the last frame written
+    long written, dropped;
+    uint8_t *out;               // frame converted to RGBA
+    uint8_t *prev;              // last frame written, repeated to fill gaps
+};
+
+// ----------------------------------------------------------------------------
+// Pick the stream format from the file extension, defaulting to raw RGBA.
+int recorder_format_from_path(const char *path)
+{
+    const char *ext = strrchr(path, '.');
+    return (ext && !strcmp(ext, ".y4m")) ? RECORD_Y4M : RECORD_RAW;
+}
+
+// ----------------------------------------------------------------------------
+// Convert a queued frame to packed RGBA with opaque alpha.
+static void convert_rgba(uint8_t *dest, const record_slot_t *slot)
+{
+    const uint8_t *src = slot->pixels;
+    int i, r = 0, b = 2, step = 4;
+
+    if (slot->format == GBX_PIXEL_BGRX8888 || slot->format == GBX_PIXEL_BGR888)
+        r = 2, b = 0;
+    if (slot->format == GBX_PIXEL_RGB888 || slot->format == GBX_PIXEL_BGR888)
+        step = 3;
+
+    for (i = 0; i < GBX_LCD_XRES * GBX_LCD_YRES; i++, src += step) {
+        *dest++ = src[r];
+        *dest++ = src[1];
+        *dest++ = src[b];
+        *dest++ = 0xFF;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Convert packed RGBA to planar 8-bit Y'CbCr with BT.601 studio swing, which
+// is what encoders assume for Y4M input without a color range tag.
+static void convert_yuv(uint8_t *dest, const uint8_t *rgba)
+{
+    const int n = GBX_LCD_XRES * GBX_LCD_YRES;
+    uint8_t *y = dest, *u = dest + n, *v = dest + 2 * n;
+    int i, r, g, b;
+
+    for (i = 0; i < n; i++, rgba += 4) {
+        r = rgba[0], g = rgba[1], b = rgba[2];
+        y[i] = (uint8_t)((( 66 * r + 129 * g +  25 * b + 128) >> 8) +  16);
+        u[i] = (uint8_t)(((-38 * r -  74 * g + 112 * b + 128) >> 8) + 128);
+        v[i] = (uint8_t)(((112 * r -  94 * g -  18 * b + 128) >> 8) + 128);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Write one frame of output, in the format it was already converted to.
+static int write_frame(recorder_t *rec, const uint8_t *data, long cycles)
+{
+    size_t size = SLOT_BYTES;
+
+    if (rec->format == RECORD_Y4M) {
+        size = GBX_LCD_XRES * GBX_LCD_YRES * 3;
+        if (cycles >= 0 && 0 > fprintf(rec->fp, "FRAME XCYCLES=%ld\n", cycles))
+            return -1;
+        if (cycles < 0 && 0 > fprintf(rec->fp, "FRAME\n"))
+            return -1;
+    }
+
+    rec->written++;
+    return (1 == fwrite(data, size, 1, rec->fp)) ? 0 : -1;
+}
+
+// ----------------------------------------------------------------------------
+// Write a queued frame. Frames that were never pushed, because they were
+// dropped here or never acquired by the caller, are replaced by repeating the
+// last frame written, so the stream keeps a constant rate.
+static int write_slot(recorder_t *rec, const record_slot_t *slot)
+{
+    long missing = (rec->last_seq >= 0) ? slot->seq - rec->last_seq - 1 : 0;
+
+    for (; missing > 0; missing--) {
+        if (write_frame(rec, rec->prev, -1))
+            return -1;
+    }
+
+    convert_rgba(rec->out, slot);
+    if (rec->format == RECORD_Y4M)
+        convert_yuv(rec->prev, rec->out);
+    else
+        memcpy(rec->prev, rec->out, SLOT_BYTES);
+
+    rec->last_seq = MAX(rec->last_seq, slot->seq);
+    return write_frame(rec, rec->prev, slot->cycles);
+}
+
+// ----------------------------------------------------------------------------
+static int writer_run(void *data)
+{
+    recorder_t *rec = (recorder_t *)data;
+    record_slot_t *slot;
+
+    mutex_lock(&rec->lock);
+    while (rec->count || !rec->quit) {
+        if (!rec->count) {
+            cond_wait(&rec->cond, &rec->lock);
+            continue;
+        }
+
+        // the caller fills other slots while this one is being written
+        slot = &rec->slots[rec->head];
+        mutex_unlock(&rec->lock);
+
+        if (!rec->failed && write_slot(rec, slot)) {
+            log_err("Failed to write recorded frame, recording stopped.\n");
+            rec->failed = 1;
+        }
+
+        mutex_lock(&rec->lock);
+        rec->head = (rec->head + 1) % RECORD_QUEUE;
+        rec->count--;
+        cond_broadcast(&rec->cond);
+    }
+    mutex_unlock(&rec->lock);
+
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Open path ("-" for standard output) and start the writer thread. Returns
+// NULL if the output or the thread could not be created.
+recorder_t *recorder_open(const char *path, int format)
+{
+    recorder_t *rec;
+    assert(NULL != path);
+
+    if (NULL == (rec = (recorder_t *)calloc(1, sizeof(recorder_t))))
+        return NULL;
+
+    rec->out = (uint8_t *)malloc(SLOT_BYTES);
+    rec->prev = (uint8_t *)calloc(1, SLOT_BYTES);
+    if (!rec->out || !rec->prev)
+        goto error_cleanup;
+
+    rec->format = format;
+    rec->last_seq = -1;
+
+    if (!strcmp(path, "-")) {
+#ifdef PLATFORM_WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        rec->fp = stdout;
+    }
+    else if (NULL == (rec->fp = fopen(path, "wb"))) {
+        log_err("Failed to open '%s' for recording.\n", path);
+        goto error_cleanup;
+    }
+
+    if (format == RECORD_Y4M &&
+        0 > fprintf(rec->fp, Y4M_HEADER, GBX_LCD_XRES, GBX_LCD_YRES)) {
+        log_err("Failed to write stream header.\n");
+        goto error_cleanup;
+    }
+
+    mutex_init(&rec->lock);
+    cond_init(&rec->cond);
+    if (thread_create(&rec->thread, writer_run, rec)) {
+        mutex_destroy(&rec->lock);
+        cond_destroy(&rec->cond);
+        goto error_cleanup;
+    }
+
+    log_info("Recording frames to '%s'.\n", path);
+    return rec;
+
+error_cleanup:
+    if (rec->fp && rec->fp != stdout)
+        fclose(rec->fp);
+    SAFE_FREE(rec->prev);
+    SAFE_FREE(rec->out);
+    SAFE_FREE(rec);
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+// Queue a copy of the frame to be written. If the queue is full, the frame is
+// dropped unless wait is set, in which case this blocks until there is room.
+// Returns 0 if the frame was queued, -1 if it was dropped. Only RGB formats
+// can be recorded. Frames are expected from a single thread.
+int recorder_push(recorder_t *rec, const gbx_frame_t *frame, int wait)
+{
+    record_slot_t *slot;
+    int row_bytes, y;
+
+    switch (frame->format) {
+    case GBX_PIXEL_RGBX8888:
+    case GBX_PIXEL_BGRX8888:
+        row_bytes = GBX_LCD_XRES * 4;
+        break;
+    case GBX_PIXEL_RGB888:
+    case GBX_PIXEL_BGR888:
+        row_bytes = GBX_LCD_XRES * 3;
+        break;
+    default:
+        return -1;
+    }
+
+    mutex_lock(&rec->lock);
+    while (wait && rec->count == RECORD_QUEUE)
+        cond_wait(&rec->cond, &rec->lock);
+
+    if (rec->count == RECORD_QUEUE) {
+        mutex_unlock(&rec->lock);
+        rec->dropped++;
+        return -1;
+    }
+
+    // the writer never touches slots past the ones queued, so the copy can
+    // be made without holding the lock
+    slot = &rec->slots[(rec->head + rec->count) % RECORD_QUEUE];
+    mutex_unlock(&rec->lock);
+
+    for (y = 0; y < GBX_LCD_YRES; y++) {
+        memcpy(&slot->pixels[y * row_bytes],
+               (const uint8_t *)frame->pixels + y * frame->pitch, row_bytes);
+    }
+    slot->format = frame->format;
+    slot->seq = frame->seq;
+    slot->cycles = frame->cycles;
+
+    mutex_lock(&rec->lock);
+    rec->count++;
+    cond_broadcast(&rec->cond);
+    mutex_unlock(&rec->lock);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Write out every queued frame, then stop the writer and close the output.
+void recorder_close(recorder_t *rec)
+{
+    if (!rec)
+        return;
+
+    mutex_lock(&rec->lock);
+    rec->quit = 1;
+    cond_broadcast(&rec->cond);
+    mutex_unlock(&rec->lock);
+    thread_join(rec->thread);
+
+    log_info("Recorded %ld frames, %ld dropped.\n", rec->written, rec->dropped);
+
+    if (rec->fp != stdout)
+        fclose(rec->fp);
+    else
+        fflush(stdout);
+
+    mutex_destroy(&rec->lock);
+    cond_destroy(&rec->cond);
+    SAFE_FREE(rec->prev);
+    SAFE_FREE(rec->out);
+    SAFE_FREE(rec);
+}
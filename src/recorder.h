@@ -0,0 +1,48 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+#ifndef GBOY_RECORDER__H
+#define GBOY_RECORDER__H
+
+#include "gbx.h"
+
+// streams frames to a file or pipe, such as the input of a video encoder. the
+// frames are queued and written by a separate thread, so the caller never
+// waits on the output unless it asks to
+
+#define RECORD_RAW      0   // packed RGBA bytes, nothing else
+#define RECORD_Y4M      1   // YUV4MPEG2 4:4:4, each frame tagged with cycles
+
+#define RECORD_QUEUE    16  // frames that may be waiting to be written
+
+typedef struct recorder recorder_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int  recorder_format_from_path(const char *path);
+recorder_t *recorder_open(const char *path, int format);
+int  recorder_push(recorder_t *rec, const gbx_frame_t *frame, int wait);
+void recorder_close(recorder_t *rec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GBOY_RECORDER__H
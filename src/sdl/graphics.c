@@ -17,8 +17,6 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
-#include <string.h>
 #include "graphics.h"
 
 // ----------------------------------------------------------------------------
@@ -29,49 +27,20 @@ graphics_t *graphics_init(int width, int height, int stretch)
     gfx->height = height;
     gfx->stretch = stretch;
 
-    gfx->pbo_sz = width * height * 4;
-    gfx->tex_dim = tex_pow2(width, height);
-
-    gfx->tex_u = gfx->width / (float)gfx->tex_dim;
-    gfx->tex_v = gfx->height / (float)gfx->tex_dim;
-
-    gfx->tex_x0 = gfx->tex_y0 = -1.0f;
-    gfx->tex_x1 = gfx->tex_y1 = 1.0f;
-
-    // set some reasonable defaults for rendering a 2d scene
-    glClearColor(0, 0, 0, 0);
-
-    glShadeModel(GL_FLAT);
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_LIGHTING);
-    glDisable(GL_CULL_FACE);
-    glEnable(GL_TEXTURE_2D);
-
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-
-    // create the render texture and pbo
-    glGenTextures(1, &gfx->texture);
-    glBindTexture(GL_TEXTURE_2D, gfx->texture);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-            gfx->tex_dim, gfx->tex_dim, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-
-    glGenBuffers(1, &gfx->pbo);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gfx->pbo);
+    if (0 != present_init(&gfx->present, width, height))
+        log_warn("OpenGL reported an error during initialization\n");
 
     return gfx;
 }
 
+// ----------------------------------------------------------------------------
+// Map memory the emulator can render frames straight into, or return NULL if
+// persistent mapping is unsupported.
+void *graphics_map_target(graphics_t *gfx, int frames, int *pitch)
+{
+    return present_map_target(&gfx->present, frames, pitch);
+}
+
 // ----------------------------------------------------------------------------
 void graphics_resize(graphics_t *gfx, int width, int height)
 {
@@ -79,8 +48,7 @@ void graphics_resize(graphics_t *gfx, int width, int height)
 
     if (gfx->stretch) {
         // stretch the image to fit the entire viewport
-        gfx->tex_x0 = gfx->tex_y0 = -1.0f;
-        gfx->tex_x1 = gfx->tex_y1 = 1.0f;
+        present_place(&gfx->present, -1.0f, -1.0f, 1.0f, 1.0f);
     }
     else {
         // fit the viewport while maintaining proper aspect ratio
@@ -89,61 +57,37 @@ void graphics_resize(graphics_t *gfx, int width, int height)
 
         if (wnd_aspect > gbx_aspect) {
             float ratio = gbx_aspect / wnd_aspect;
-            gfx->tex_y0 = -1.0f;
-            gfx->tex_y1 = 1.0f;
-            gfx->tex_x0 = -ratio;
-            gfx->tex_x1 = ratio;
+            present_place(&gfx->present, -ratio, -1.0f, ratio, 1.0f);
         }
         else {
             float ratio = wnd_aspect / gbx_aspect;
-            gfx->tex_y0 = -ratio;
-            gfx->tex_y1 = ratio;
-            gfx->tex_x0 = -1.0f;
-            gfx->tex_x1 = 1.0f;
+            present_place(&gfx->present, -1.0f, -ratio, 1.0f, ratio);
         }
     }
 }
 
 // ----------------------------------------------------------------------------
-void graphics_update(graphics_t *gfx, uint32_t *src)
+// Must be called before acquiring a frame, see present_wait.
+void graphics_wait(graphics_t *gfx)
 {
-    uint32_t *pbuf;
-
-    // lock the pbo for write only access and copy over the framebuffer
-    glBufferData(GL_PIXEL_UNPACK_BUFFER, gfx->pbo_sz, NULL, GL_DYNAMIC_DRAW);
-    pbuf = (uint32_t *)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
-
-    memcpy(pbuf, src, gfx->pbo_sz);
+    present_wait(&gfx->present);
+}
 
-    // unlock the pbo
-    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
-            gfx->width, gfx->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+// ----------------------------------------------------------------------------
+void graphics_update(graphics_t *gfx, const gbx_frame_t *frame)
+{
+    present_upload(&gfx->present, frame);
 }
 
 // ----------------------------------------------------------------------------
 void graphics_render(graphics_t *gfx)
 {
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    // TODO: replace this with a vbo
-    glBegin(GL_QUADS);
-    glTexCoord2f(0.0f, gfx->tex_v);
-    glVertex3f(gfx->tex_x0, gfx->tex_y0, 0.0f); 
-    glTexCoord2f(gfx->tex_u, gfx->tex_v);
-    glVertex3f(gfx->tex_x1, gfx->tex_y0, 0.0f); 
-    glTexCoord2f(gfx->tex_u, 0.0f);
-    glVertex3f(gfx->tex_x1, gfx->tex_y1, 0.0f); 
-    glTexCoord2f(0.0f, 0.0f);
-    glVertex3f(gfx->tex_x0, gfx->tex_y1, 0.0f);
-    glEnd();
+    present_draw(&gfx->present);
 }
 
 // ----------------------------------------------------------------------------
 void graphics_shutdown(graphics_t *gfx)
 {
-    glDeleteBuffers(1, &gfx->pbo);
-    glDeleteTextures(1, &gfx->texture);
+    present_shutdown(&gfx->present);
     SAFE_FREE(gfx);
 }
-
@@ -18,39 +18,19 @@
 #ifndef GBOY_GRAPHICS__H
 #define GBOY_GRAPHICS__H
 
-#include <GL/glew.h>
-#include "common.h"
-
-#define GFX_FB_SIZE (4 * GBX_LCD_XRES * GBX_LCD_YRES)
+#include "present.h"
 
 typedef struct graphics {
-    GLuint pbo, texture;
-    int pbo_sz, tex_dim;
-    float tex_u, tex_v;
-    float tex_x0, tex_y0, tex_x1, tex_y1;
+    present_t present;
     int width, height, stretch;
 } graphics_t;
 
 graphics_t *graphics_init(int width, int height, int stretch);
 void graphics_resize(graphics_t *gfx, int width, int height);
-void graphics_update(graphics_t *gfx, uint32_t *src);
+void *graphics_map_target(graphics_t *gfx, int frames, int *pitch);
+void graphics_wait(graphics_t *gfx);
+void graphics_update(graphics_t *gfx, const gbx_frame_t *frame);
 void graphics_render(graphics_t *gfx);
 void graphics_shutdown(graphics_t *gfx);
 
-// ----------------------------------------------------------------------------
-// Return the nearest square, pow2 texture dimension >= MAX(width, height).
-INLINE unsigned int tex_pow2(unsigned int width, unsigned int height)
-{
-    unsigned int input = MAX(width, height);
-    unsigned int value = 2;
-
-    if (0 == (input & (input - 1)))
-        return input;
-
-    while (0 != (input >>= 1))
-        value <<= 1;
-    return value;
-}
-
 #endif // GBOY_GRAPHICS__H
-
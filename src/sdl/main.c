@@ -23,6 +23,7 @@
 #include "SDL_thread.h"
 #include "gbx.h"
 #include "graphics.h"
+#include "recorder.h"
 #include "sound.h"
 
 #define GBOY_TITLE "gboy " GBOY_VERSION_STR
@@ -30,17 +31,21 @@
 #define GBOY_EVENT_SYNC 0
 #define GBOY_EVENT_PERF 1
 
+#define AUDIO_RATE      44100
+#define AUDIO_LATENCY   20      // ms of sound buffered ahead of the device
+#define AUDIO_WAIT_MS   100     // longest wait on the device before giving up
+
 typedef struct gbx_thread {
     gbx_context_t *ctx;         // gbx emulator context
     SDL_Thread *thread;         // handle to this thread
     int running;                // control thread termination
     int limit_speed;            // when set, cpu throttling is enabled
     int enable_sound;           // enable or disable sound playback
+    int pace_audio;             // when set, the sound device sets the speed
     int debugger;               // when set, debug tracing is enabled
     int cycles_per_update;      // cycles to execute between each delay
     float clock_rate;           // keep track of freq (in Hz) for throttling
     float real_period;          // period considering integer cycle counts
-    uint32_t fb[GFX_FB_SIZE];   // video framebuffer
     sound_t *snd;
 } gbx_thread_t;
 
@@ -56,6 +61,7 @@ typedef struct window_state {
     SDL_GLContext *glctx;       // handle to OpenGL render context
     int width, height, fs;      // dimensions and full-screen enable/disable
     int stretch;                // control stretched or aspect correct display
+    recorder_t *rec;            // stream of displayed frames, if recording
 } window_state_t;
 
 // ----------------------------------------------------------------------------
@@ -105,8 +111,7 @@ void ext_log_message(int level, const char *msg)
 // Callback fired each time the emulator enters the vertical blank period.
 void ext_video_sync(void *data)
 {
-    gbx_thread_t *gt = (gbx_thread_t *)data;
-    gbx_get_framebuffer(gt->ctx, gt->fb);
+    // the frame has already been published, just wake up the window thread
     push_user_event(GBOY_EVENT_SYNC, NULL, NULL);
 }
 
@@ -127,10 +132,6 @@ void ext_speed_change(void *data, int speed)
     }
 
     set_gbx_frequency(gt, hz);
-
-    if (gt->enable_sound) {
-        sound_set_freq(gt->snd, hz);
-    }
 }
 
 // ----------------------------------------------------------------------------
@@ -138,36 +139,18 @@ void ext_speed_change(void *data, int speed)
 void ext_lcd_enabled(void *data, int enabled)
 {
     if (!enabled) {
-        // if LCD disabled, set entire display area to solid white
-        memset(((gbx_thread_t *)data)->fb, 0xFF, GFX_FB_SIZE);
+        // if LCD disabled, the core publishes a solid white frame to display
         push_user_event(GBOY_EVENT_SYNC, NULL, NULL);
     }
 }
 
 // ----------------------------------------------------------------------------
-void ext_sound_write(void *data, uint16_t addr, uint8_t value)
-{
-    gbx_thread_t *gt = (gbx_thread_t *)data;
-    if (gt->enable_sound) {
-        sound_write(gt->snd, gt->ctx->frame_cycles, addr, value);
-    }
-}
-
-// ----------------------------------------------------------------------------
-void ext_sound_read(void *data, uint16_t addr, uint8_t *value)
-{
-    gbx_thread_t *gt = (gbx_thread_t *)data;
-    if (gt->enable_sound) {
-        *value = sound_read(gt->snd, gt->ctx->frame_cycles, addr);
-    }
-}
-
-// ----------------------------------------------------------------------------
+// Callback fired at the end of each sound frame, once its samples are ready.
 void ext_sound_frame(void *data)
 {
     gbx_thread_t *gt = (gbx_thread_t *)data;
-    if (gt->enable_sound) {
-        sound_render(gt->snd, 20000 * 8);
+    if (gt->snd) {
+        sound_update(gt->snd, gt->ctx);
     }
 }
 
@@ -186,6 +169,15 @@ int gbx_thread_run(void *data)
 
     // execute instructions until the thread is terminated
     while (gt->running) {
+        // run a sound frame each time the device drains to the target latency,
+        // so there is no drift between the two clocks to correct for. if the
+        // device stalls, keep going and let the buffer overrun instead
+        if (gt->limit_speed && gt->pace_audio) {
+            sound_wait(gt->snd, AUDIO_WAIT_MS);
+            gbx_execute_cycles(ctx, SOUND_FRAME_CYCLES);
+            continue;
+        }
+
         prev = SDL_GetPerformanceCounter();
         gbx_execute_cycles(ctx, gt->cycles_per_update);
         curr = SDL_GetPerformanceCounter();
@@ -232,11 +224,36 @@ gbx_thread_t *gbx_thread_create(gbx_context_t *ctx, cmdargs_t *ca)
         gbx_set_serial_log(ctx, ca->serial_path);
     }
 
+    gbx_set_color_profile(ctx, ca->color_profile, ca->color_gamma);
+
+    if (ca->ghosting && gbx_set_frame_blend(ctx, ca->ghosting)) {
+        log_err("failed to enable frame blending\n");
+    }
+
+    // on multi-core hosts, draw each frame while the next one is emulated
+    if (ca->render_thread && gbx_set_render_thread(ctx, 1)) {
+        log_err("failed to create render thread, rendering inline\n");
+    }
+
+    // keep the costly part of sound generation off the emulator thread
+    if (ca->audio_thread && gbx_set_audio_thread(ctx, 1)) {
+        log_err("failed to create audio thread, synthesizing inline\n");
+    }
+
+    // sound is only generated while it can be heard at the right speed
+    gbx_set_audio_synthesis(ctx, gt->enable_sound && gt->limit_speed);
+
     // initialize sound library
     if (gt->enable_sound) {
         log_info("Initializing APU library...\n");
-        gt->snd = sound_init(44100, 4096);
-        sound_set_freq(gt->snd, CPU_FREQ_DMG);
+        gbx_set_audio_rate(ctx, AUDIO_RATE);
+        gt->snd = sound_init(AUDIO_RATE, AUDIO_LATENCY,
+                             SYNC_AUDIO == ca->sync_mode);
+        gt->pace_audio = gt->snd && SYNC_AUDIO == ca->sync_mode;
+    }
+
+    if (SYNC_AUDIO == ca->sync_mode && !gt->pace_audio) {
+        log_err("audio sync requires sound playback, using the timer\n");
     }
 
     // create and launch the emulator thread
@@ -345,9 +362,11 @@ static int keysym_to_joypad(int keysym)
 int process_window_events(gbx_thread_t *gt, window_state_t *ws)
 {
     SDL_Event event;
+    gbx_frame_t frame;
+    sound_stats_t stats;
     long cps, pct;
-    int input_index;
-    char buffer[64];
+    int input_index, len;
+    char buffer[128];
     graphics_t *gfx = ws->gfx;
 
     while (SDL_PollEvent(&event)) {
@@ -358,12 +377,28 @@ int process_window_events(gbx_thread_t *gt, window_state_t *ws)
                 // report frequency and % target speed in window title
                 cps = (size_t)event.user.data1;
                 pct = (long)(100.0f * cps / 4194304.0f + 0.5f);
-                snprintf(buffer, 64, "%s [%ldHz %ld%%]", GBOY_TITLE, cps, pct);
+                len = snprintf(buffer, sizeof(buffer), "%s [%ldHz %ld%%]",
+                               GBOY_TITLE, cps, pct);
+
+                // along with how the sound device is keeping up
+                if (gt->snd) {
+                    sound_get_stats(gt->snd, &stats);
+                    snprintf(buffer + len, sizeof(buffer) - len,
+                             " [%dms audio, %ld underruns]",
+                             stats.latency_ms, stats.underruns);
+                }
                 SDL_SetWindowTitle(ws->wnd, buffer);
                 break;
             case GBOY_EVENT_SYNC:
-                // flip the back buffer on each LCD v-blank event
-                graphics_update(gfx, gt->fb);
+                // upload the latest frame, unless it was already displayed
+                graphics_wait(gfx);
+                if (!gbx_acquire_frame(gt->ctx, &frame))
+                    break;
+
+                // frames the queue has no room for are replaced by repeats
+                if (ws->rec)
+                    recorder_push(ws->rec, &frame, 0);
+                graphics_update(gfx, &frame);
                 break;
             }
             break;
@@ -397,6 +432,8 @@ int process_window_events(gbx_thread_t *gt, window_state_t *ws)
                     gt->limit_speed = !gt->limit_speed;
                     log_info("emulator speed throttling %s\n",
                              gt->limit_speed ? "enabled" : "disabled");
+                    gbx_set_audio_synthesis(gt->ctx,
+                            gt->enable_sound && gt->limit_speed);
                 }
 
                 break;
@@ -419,21 +456,28 @@ int process_window_events(gbx_thread_t *gt, window_state_t *ws)
 // ----------------------------------------------------------------------------
 int window_event_pump(gbx_thread_t *gt, window_state_t *ws)
 {
-    ws->gfx = graphics_init(GBX_LCD_XRES, GBX_LCD_YRES, ws->stretch);
-
     while (process_window_events(gt, ws)) {
         // render the surface and swap buffers
         graphics_render(ws->gfx);
         SDL_GL_SwapWindow(ws->wnd);
     }
 
-    graphics_shutdown(ws->gfx);
-    SDL_GL_DeleteContext(ws->glctx);
-    SDL_DestroyWindow(ws->wnd);
-
     return 1;
 }
 
+// ----------------------------------------------------------------------------
+// Release the graphics back-end and window. The emulator thread must already
+// be stopped, as it may be rendering into memory owned by the back-end.
+void destroy_sdl_window(window_state_t *ws)
+{
+    if (ws->gfx)
+        graphics_shutdown(ws->gfx);
+    if (ws->glctx)
+        SDL_GL_DeleteContext(ws->glctx);
+    if (ws->wnd)
+        SDL_DestroyWindow(ws->wnd);
+}
+
 // ----------------------------------------------------------------------------
 int main(int argc, char *argv[])
 {
@@ -442,10 +486,12 @@ int main(int argc, char *argv[])
     gbx_thread_t *gt = NULL;
     window_state_t ws = {0};
     perf_args_t pa = {0};
+    void *target;
+    int pitch;
 
     // process and validate the command line arguments
-    if (cmdline_parse(argc, argv, &ca)) {
-        cmdline_display_usage();
+    if (cmdline_parse(argc, argv, &ca, CMDLINE_FE_SDL)) {
+        cmdline_display_usage(CMDLINE_FE_SDL);
     }
 
     // create an emulator context for the given system type (default AUTO)
@@ -467,6 +513,19 @@ int main(int argc, char *argv[])
     if (create_sdl_window(&ws, &ca))
         goto error_cleanup;
 
+    // have the core render directly into a mapped pbo when the driver allows,
+    // unless frames are recorded, as the mapping can't be read back
+    ws.gfx = graphics_init(GBX_LCD_XRES, GBX_LCD_YRES, ws.stretch);
+    if (ca.record_path) {
+        ws.rec = recorder_open(ca.record_path,
+                               recorder_format_from_path(ca.record_path));
+        if (NULL == ws.rec)
+            goto error_cleanup;
+    }
+    else if (NULL != (target = graphics_map_target(ws.gfx, GBX_FB_COUNT,
+                                                   &pitch)))
+        gbx_set_framebuffer_target(ctx, target, pitch, GBX_PIXEL_RGBX8888);
+
     if (NULL == (gt = gbx_thread_create(ctx, &ca)))
         goto error_cleanup;
 
@@ -480,6 +539,8 @@ int main(int argc, char *argv[])
 error_cleanup:
     SDL_RemoveTimer(pa.id);
     gbx_thread_destroy(gt);
+    recorder_close(ws.rec);
+    destroy_sdl_window(&ws);
     gbx_destroy_context(ctx);
     cmdline_destroy(&ca);
     return 0;
@@ -15,94 +15,217 @@
 // with this program; if not, write to the Free Software Foundation, Inc.,
 // 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
-#include "Gb_Apu.h"
-#include "Multi_Buffer.h"
+#include <string.h>
 #include "Sync_Audio.h"
 #include "gbx.h"
 #include "sound.h"
 
+// stereo sample pairs moved from the emulator at a time
+#define SOUND_CHUNK         512
+
+// the clock rate is adjusted by at most this fraction to steer the amount of
+// buffered audio toward the target latency, reaching it once the buffer is off
+// target by half the target
+#define DRC_MAX_DELTA       0.005
+#define DRC_GAIN            2.0
+
+// weight of each new fill level measurement in the running average, which
+// hides the sawtooth of bursty writes and device callbacks
+#define DRC_SMOOTHING       (1.0 / 64)
+
+// the target latency adapts to the host. the device callbacks are measured
+// over each period of sound frames, the target is raised by half after any of
+// them ran out of samples, and lowered toward the least that was still enough
+// once playback has stayed clean for long enough. every underrun doubles how
+// long that is, so a target too low for the host is not retried too often
+#define TUNE_FRAMES         128
+#define TUNE_CLEAN          8
+#define TUNE_CLEAN_MAX      64
+#define LATENCY_MAX_MS      200
+
 struct blargg_sound {
-    Gb_Apu apu;
     Sync_Audio queue;
-    Stereo_Buffer buf;
-    blip_sample_t *out_buf;
-    int out_size;
+    int16_t out_buf[SOUND_CHUNK * 2];
     int sample_rate;
+    long volatile target_fill;  // samples buffered at the target latency
+    double avg_fill;            // running average of the buffered samples
+    int pace;                   // the device paces the emulator via sound_wait
+    long max_fill;              // highest the target may be raised to
+    int frames;                 // sound frames into the measurement period
+    int idle;                   // no sound was produced during the period
+    int clean;                  // periods in a row without an underrun
+    int clean_needed;           // clean periods before the target is lowered
+    long volatile fill;         // average fill over the last period
+    long volatile jitter;       // microseconds the latest callback was late by
+    long volatile underruns;    // callbacks that ran out of samples
 };
 
 // ----------------------------------------------------------------------------
-sound_t *sound_init(int sample_rate, int buff_size)
+// Convert a number of buffered samples to milliseconds of audio.
+static int samples_to_ms(blargg_sound *psnd, long count)
 {
-    blargg_sound *psnd = new blargg_sound;
-    psnd->out_buf = new blip_sample_t[buff_size];
-    psnd->out_size = buff_size;
-    psnd->sample_rate = sample_rate;
+    return (int)(count * 1000 / (psnd->sample_rate * 2));
+}
 
-    const char *rate_err = psnd->buf.set_sample_rate(sample_rate);
-    if (rate_err) {
-        log_err("error in APU: %s\n", rate_err);
-        return NULL;
+// ----------------------------------------------------------------------------
+// Nudge the clock rate the emulator's sound is resampled from, so the buffer
+// neither drains nor fills up when the audio device and the emulator drift
+// apart. A full buffer raises the clock rate, producing fewer samples.
+static void update_rate(blargg_sound *psnd, gbx_context_t *ctx)
+{
+    double error;
+
+    error = (psnd->avg_fill - psnd->target_fill) / psnd->target_fill;
+    error = MAX(-1.0, MIN(error * DRC_GAIN, 1.0));
+
+    gbx_adjust_audio_clock(ctx, 1.0 + error * DRC_MAX_DELTA);
+}
+
+// ----------------------------------------------------------------------------
+// Write silence until the buffer holds count samples.
+static void pad_to(blargg_sound *psnd, long count)
+{
+    memset(psnd->out_buf, 0, sizeof(psnd->out_buf));
+    for (long n = count - psnd->queue.sample_count(); n > 0;
+         n -= SOUND_CHUNK * 2)
+        psnd->queue.write(psnd->out_buf, MIN(n, SOUND_CHUNK * 2));
+}
+
+// ----------------------------------------------------------------------------
+// At the end of each measurement period, adjust the target latency to what the
+// device callbacks needed during it, and publish the measurements.
+static void tune_latency(blargg_sound *psnd)
+{
+    Sync_Audio::stats_t stats;
+    long period_us, target = psnd->target_fill;
+
+    if (++psnd->frames < TUNE_FRAMES)
+        return;
+
+    psnd->frames = 0;
+    psnd->queue.take_stats(&stats);
+
+    // while the emulator produced nothing the device was bound to run dry, so
+    // the period says nothing about the host
+    if (psnd->idle || 0 == stats.callbacks) {
+        psnd->idle = 0;
+        return;
+    }
+
+    period_us = (long)psnd->queue.callback_size() * 500000 / psnd->sample_rate;
+    ATOMIC_STORE(&psnd->jitter, MAX(0, stats.max_gap - period_us));
+    ATOMIC_STORE(&psnd->fill, (long)psnd->avg_fill);
+    ATOMIC_STORE(&psnd->underruns, psnd->underruns + stats.short_count);
+
+    if (stats.short_count) {
+        // raise the target at once and fill up to it, the damage is done
+        target = MIN(target + target / 2, psnd->max_fill);
+        psnd->clean = 0;
+        psnd->clean_needed = MIN(psnd->clean_needed * 2, TUNE_CLEAN_MAX);
+        pad_to(psnd, target);
+    }
+    else if (++psnd->clean >= psnd->clean_needed) {
+        // a callback has to find at least its own size waiting, anything above
+        // that was spare. give back half of it, the rate control drains it
+        long spare = stats.min_fill - psnd->queue.callback_size();
+        if (spare > 0)
+            target = MAX(target - spare / 2, psnd->queue.callback_size());
+        psnd->clean = 0;
     }
 
-    psnd->apu.output(psnd->buf.center(), psnd->buf.left(), psnd->buf.right());
+    if (target != psnd->target_fill) {
+        log_spew("APU target latency %d ms\n", samples_to_ms(psnd, target));
+        ATOMIC_STORE(&psnd->target_fill, target);
+    }
+}
 
-    const char *start_err = psnd->queue.start(sample_rate, 2);
+// ----------------------------------------------------------------------------
+// Initialize sound output, buffering about latency_ms of audio. If pace is set,
+// the emulator runs whenever sound_wait returns instead of by its own timer,
+// so the device clock sets its speed and the rate is left alone.
+sound_t *sound_init(int sample_rate, int latency_ms, int pace)
+{
+    blargg_sound *psnd = new blargg_sound;
+    psnd->sample_rate = sample_rate;
+    psnd->pace = pace;
+    psnd->target_fill = (long)sample_rate * 2 * latency_ms / 1000;
+    psnd->max_fill = (long)sample_rate * 2 * LATENCY_MAX_MS / 1000;
+    psnd->avg_fill = psnd->target_fill;
+    psnd->frames = 0;
+    psnd->idle = 0;
+    psnd->clean = 0;
+    psnd->clean_needed = TUNE_CLEAN;
+    psnd->fill = psnd->target_fill;
+    psnd->jitter = 0;
+    psnd->underruns = 0;
+
+    // the ring has room for twice the highest target, so the rate control has
+    // the same headroom in both directions
+    const char *start_err = psnd->queue.start(sample_rate, 2,
+                                              LATENCY_MAX_MS * 2);
     if (start_err) {
         log_err("error in APU: %s\n", start_err);
+        SAFE_DELETE(psnd);
         return NULL;
     }
 
+    // start out at the target latency instead of slowly filling up to it
+    pad_to(psnd, psnd->target_fill);
+
     return (sound_t *)psnd;
 }
 
 // ----------------------------------------------------------------------------
-void sound_set_freq(sound_t *snd, int hz)
+// Move the sound the emulator produced into the device buffer. Call this from
+// the emulator thread at the end of every sound frame.
+void sound_update(sound_t *snd, gbx_context_t *ctx)
 {
     blargg_sound *psnd = (blargg_sound *)snd;
-    psnd->buf.clock_rate(hz);
+    long count, total = 0;
+
+    while (0 != (count = gbx_read_audio(ctx, psnd->out_buf, SOUND_CHUNK))) {
+        psnd->queue.write(psnd->out_buf, count * 2);
+        log_spew("APU processed %ld samples\n", count);
+        total += count;
+    }
+
+    psnd->avg_fill += (psnd->queue.sample_count() - psnd->avg_fill) *
+                      DRC_SMOOTHING;
+    psnd->idle |= !total;
+    tune_latency(psnd);
+
+    if (!psnd->pace)
+        update_rate(psnd, ctx);
 }
 
 // ----------------------------------------------------------------------------
-void sound_write(sound_t *snd, int cycle, uint16_t addr, uint8_t value)
+// Sleep until the device has played the buffer down below the target latency,
+// so it needs more sound. Returns -1 if that took longer than timeout_ms.
+int sound_wait(sound_t *snd, int timeout_ms)
 {
     blargg_sound *psnd = (blargg_sound *)snd;
-    if (addr < psnd->apu.start_addr || addr > psnd->apu.end_addr) {
-        log_err("APU write error: address %04X out of range\n", addr);
-        return;
-    }
-
-    psnd->apu.write_register(cycle, addr, value);
+    long target = ATOMIC_LOAD(&psnd->target_fill);
+    return psnd->queue.wait_below(target, timeout_ms) ? 0 : -1;
 }
 
 // ----------------------------------------------------------------------------
-uint8_t sound_read(sound_t *snd, int cycle, uint16_t addr)
+// Report how the device is keeping up. Safe to call from any thread.
+void sound_get_stats(sound_t *snd, sound_stats_t *stats)
 {
     blargg_sound *psnd = (blargg_sound *)snd;
-    if (addr < psnd->apu.start_addr || addr > psnd->apu.end_addr) {
-        log_err("APU read error: address %04X out of range\n", addr);
-        return 0xFF;
-    }
-
-    return psnd->apu.read_register(cycle, addr);
+    stats->latency_ms = samples_to_ms(psnd, ATOMIC_LOAD(&psnd->target_fill));
+    stats->fill_ms = samples_to_ms(psnd, ATOMIC_LOAD(&psnd->fill));
+    stats->jitter_us = ATOMIC_LOAD(&psnd->jitter);
+    stats->underruns = ATOMIC_LOAD(&psnd->underruns);
+    stats->overruns = psnd->queue.overrun_count();
 }
 
 // ----------------------------------------------------------------------------
-void sound_render(sound_t *snd, int cycle)
+// Return the number of samples waiting to be played.
+int sound_buffer_fill(sound_t *snd)
 {
     blargg_sound *psnd = (blargg_sound *)snd;
-
-//  log_info("sound_render end_frame: cycle=%d\n", cycle);
-
-    psnd->apu.end_frame(cycle);
-    psnd->buf.end_frame(cycle);
-
-    while (psnd->buf.samples_avail() >= psnd->out_size) {
-        size_t count = psnd->buf.read_samples(psnd->out_buf, psnd->out_size);
-        psnd->queue.write(psnd->out_buf, count);
-
-        log_spew("APU cycle %d processed %d samples, %d available\n",
-                 cycle, psnd->out_size, psnd->buf.samples_avail());
-    }
+    return psnd->queue.sample_count();
 }
 
 // ----------------------------------------------------------------------------
@@ -110,8 +233,11 @@ void sound_shutdown(sound_t *snd)
 {
     blargg_sound *psnd = (blargg_sound *)snd;
     if (snd) {
-        SAFE_BDELETE(psnd->out_buf);
+        log_info("APU dropped %ld samples, played %ld samples of silence\n",
+                 psnd->queue.overrun_count(), psnd->queue.underrun_count());
+        log_info("APU latency settled at %d ms after %ld underruns\n",
+                 samples_to_ms(psnd, psnd->target_fill), psnd->underruns);
+        psnd->queue.stop();
         SAFE_DELETE(psnd);
     }
 }
-
@@ -18,19 +18,27 @@
 #ifndef GBOY_SOUND__H
 #define GBOY_SOUND__H
 
-#include "common.h"
+#include "gbx.h"
 
 typedef void sound_t;
 
+typedef struct sound_stats {
+    int latency_ms;     // audio the emulator currently keeps buffered ahead
+    int fill_ms;        // audio that was actually buffered, on average
+    long jitter_us;     // how late the latest device callback was, at worst
+    long underruns;     // device callbacks that ran out of samples
+    long overruns;      // samples dropped because the buffer was full
+} sound_stats_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-sound_t *sound_init(int sample_rate, int buff_size);
-void     sound_set_freq(sound_t *snd, int hz);
-void     sound_write(sound_t *snd, int cycles, uint16_t addr, uint8_t value);
-uint8_t  sound_read(sound_t *snd, int cycles, uint16_t addr);
-void     sound_render(sound_t *snd, int cycles);
+sound_t *sound_init(int sample_rate, int latency_ms, int pace);
+void     sound_update(sound_t *snd, gbx_context_t *ctx);
+int      sound_wait(sound_t *snd, int timeout_ms);
+int      sound_buffer_fill(sound_t *snd);
+void     sound_get_stats(sound_t *snd, sound_stats_t *stats);
 void     sound_shutdown(sound_t *snd);
 
 #ifdef __cplusplus
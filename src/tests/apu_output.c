@@ -0,0 +1,98 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "gbx.h"
+#include "apu.h"
+
+// plays pseudo random register writes and prints a hash of the mixed and
+// per-oscillator output. it is built twice, with and without the SSE2 sample
+// readers, and the two builds must print the same thing
+
+#define FRAMES      240
+#define WRITES      16      // register writes per sound frame
+#define CHUNK       1024    // sample pairs read at a time
+
+void ext_log_message(int level, const char *msg) { }
+
+// ----------------------------------------------------------------------------
+static uint32_t hash_samples(uint32_t hash, const int16_t *src, long count)
+{
+    long i;
+
+    // 32-bit FNV-1a over the little endian bytes of each sample
+    for (i = 0; i < count; i++) {
+        hash = (hash ^ (uint8_t)src[i]) * 16777619;
+        hash = (hash ^ (uint8_t)(src[i] >> 8)) * 16777619;
+    }
+    return hash;
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    static int16_t samples[CHUNK * 2], stems[CHUNK * APU_STEMS];
+    uint32_t mix_hash = 2166136261u, stem_hash = 2166136261u;
+    long mix_count = 0, stem_count = 0, count;
+    unsigned seed = 1;
+    apu_t *apu;
+    int frame, i;
+
+    if (NULL == (apu = apu_create(APU_SAMPLE_RATE)) || apu_set_stems(apu, 1)) {
+        printf("unable to create an apu\n");
+        return EXIT_FAILURE;
+    }
+
+    // full volume, so the mix clamps whenever several oscillators line up
+    apu_write(apu, 0, 0xFF26, 0x80);
+    apu_write(apu, 0, 0xFF25, 0xFF);
+    apu_write(apu, 0, 0xFF24, 0x77);
+
+    for (frame = 0; frame < FRAMES; frame++) {
+        for (i = 0; i < WRITES; i++) {
+            uint16_t addr;
+            uint8_t value;
+
+            seed = seed * 1103515245 + 12345;
+            addr = 0xFF10 + (seed >> 16) % 0x30;
+            seed = seed * 1103515245 + 12345;
+            value = (uint8_t)(seed >> 16);
+
+            // leave the master volume and power alone
+            if (addr == 0xFF24 || (addr >= 0xFF26 && addr < 0xFF30))
+                continue;
+            apu_write(apu, (SOUND_FRAME_CYCLES / WRITES) * i, addr, value);
+        }
+        apu_end_frame(apu, SOUND_FRAME_CYCLES);
+
+        while ((count = apu_read_samples(apu, samples, CHUNK))) {
+            mix_hash = hash_samples(mix_hash, samples, count * 2);
+            mix_count += count;
+        }
+        while ((count = apu_read_stems(apu, stems, CHUNK))) {
+            stem_hash = hash_samples(stem_hash, stems, count * APU_STEMS);
+            stem_count += count;
+        }
+    }
+
+    apu_destroy(apu);
+
+    printf("mix %ld %08lx\n", mix_count, (unsigned long)mix_hash);
+    printf("stems %ld %08lx\n", stem_count, (unsigned long)stem_hash);
+    return (mix_count && stem_count) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
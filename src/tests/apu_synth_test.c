@@ -0,0 +1,123 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gbx.h"
+#include "apu.h"
+
+// plays the same register writes with synthesis on, off and switched on and
+// off mid-run, and checks that NR52 and NR12 read back the same each time.
+// returns nonzero on any mismatch
+
+#define FRAMES      240
+#define WRITES      16      // register writes per sound frame
+#define TOGGLE      7       // sound frames between synthesis changes
+
+enum { SYNTH_ON, SYNTH_OFF, SYNTH_TOGGLED, SYNTH_RUNS };
+
+void ext_log_message(int level, const char *msg) { }
+
+// ----------------------------------------------------------------------------
+static int run(int mode, uint8_t *log)
+{
+    static int16_t samples[4096 * 2];
+    unsigned seed = 1;
+    apu_t *apu;
+    int frame, i;
+    long cycle;
+
+    if (NULL == (apu = apu_create(APU_SAMPLE_RATE)))
+        return -1;
+
+    apu_set_synthesis(apu, mode != SYNTH_OFF);
+    apu_write(apu, 0, 0xFF26, 0x80);
+    apu_write(apu, 0, 0xFF25, 0xFF);
+    apu_write(apu, 0, 0xFF24, 0x77);
+
+    for (frame = 0; frame < FRAMES; frame++) {
+        if (mode == SYNTH_TOGGLED && 0 == frame % TOGGLE)
+            apu_set_synthesis(apu, (frame / TOGGLE) & 1);
+
+        // the same pseudo random writes every run, triggering channels with
+        // and without their length counters enabled
+        for (i = 0; i < WRITES; i++) {
+            uint16_t addr;
+            uint8_t value;
+
+            seed = seed * 1103515245 + 12345;
+            addr = 0xFF10 + (seed >> 16) % 0x16;
+            seed = seed * 1103515245 + 12345;
+            value = (uint8_t)(seed >> 16);
+
+            cycle = (SOUND_FRAME_CYCLES / WRITES) * i;
+            apu_write(apu, cycle, addr, value);
+            *log++ = apu_read(apu, cycle + 4, 0xFF26);
+            *log++ = apu_read(apu, cycle + 4, 0xFF12);
+        }
+
+        apu_end_frame(apu, SOUND_FRAME_CYCLES);
+        while (apu_read_samples(apu, samples, 4096))
+            ;
+    }
+
+    apu_destroy(apu);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    static const char *names[] = { "on", "off", "toggled" };
+    static uint8_t log[SYNTH_RUNS][FRAMES * WRITES * 2];
+    int mode, i, failed = 0;
+
+    for (mode = 0; mode < SYNTH_RUNS; mode++) {
+        if (run(mode, log[mode])) {
+            printf("unable to create an apu\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // the channels must actually start and stop for the check to mean much
+    for (i = 2; i < sizeof(log[0]); i += 2) {
+        if ((log[SYNTH_ON][i] ^ log[SYNTH_ON][0]) & 0x0F)
+            break;
+    }
+    if (i >= sizeof(log[0])) {
+        printf("NR52 never changes\n");
+        failed = 1;
+    }
+
+    for (mode = 1; mode < SYNTH_RUNS; mode++) {
+        for (i = 0; i < sizeof(log[0]); i++) {
+            if (log[mode][i] != log[SYNTH_ON][i]) {
+                printf("synthesis %s: %s read %d is %02x, expected %02x\n",
+                       names[mode], (i & 1) ? "NR12" : "NR52", i / 2,
+                       log[mode][i], log[SYNTH_ON][i]);
+                failed = 1;
+                break;
+            }
+        }
+    }
+
+    if (failed)
+        return EXIT_FAILURE;
+    printf("all register reads match\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+# -----------------------------------------------------------------------------
+# runs two builds of the same test program, failing unless both succeed and
+# print exactly the same output. usage:
+#   cmake -DFIRST=<program> -DSECOND=<program> -P compare_output.cmake
+# -----------------------------------------------------------------------------
+
+execute_process(COMMAND ${FIRST} RESULT_VARIABLE first_result
+                OUTPUT_VARIABLE first_output)
+execute_process(COMMAND ${SECOND} RESULT_VARIABLE second_result
+                OUTPUT_VARIABLE second_output)
+
+message("${FIRST}:\n${first_output}")
+message("${SECOND}:\n${second_output}")
+
+if(NOT first_result EQUAL 0 OR NOT second_result EQUAL 0)
+    message(FATAL_ERROR "a test program failed")
+endif()
+
+if(NOT first_output STREQUAL second_output)
+    message(FATAL_ERROR "the outputs differ")
+endif()
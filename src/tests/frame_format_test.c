@@ -0,0 +1,126 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gbx.h"
+#include "ports.h"
+
+// renders the same screen in every output format, and checks that each one
+// expands back to the RGBX8888 frame. returns nonzero on any mismatch
+
+#define ROM_PATH    "frame_format_test.gb"
+#define ROM_SIZE    0x8000
+#define FRAMES      3
+
+void ext_log_message(int level, const char *msg) { }
+void ext_video_sync(void *data) { }
+void ext_speed_change(void *data, int speed) { }
+void ext_lcd_enabled(void *data, int enabled) { }
+void ext_sound_frame(void *data) { }
+
+// ----------------------------------------------------------------------------
+static int write_rom(const char *path)
+{
+    static uint8_t rom[ROM_SIZE];
+    FILE *fp;
+
+    if (NULL == (fp = fopen(path, "wb")))
+        return -1;
+
+    // a blank rom only cart, which runs nops until the screen is checked
+    fwrite(rom, 1, sizeof(rom), fp);
+    fclose(fp);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int render_screen(int format, uint32_t *dest)
+{
+    gbx_context_t *ctx;
+    unsigned seed = 1;
+    int i;
+
+    if (gbx_create_context(&ctx, SYSTEM_DMG) || gbx_load_file(ctx, ROM_PATH))
+        return -1;
+
+    gbx_set_framebuffer_target(ctx, NULL, 0, format);
+    gbx_power_on(ctx);
+
+    // the same pseudo random tiles, map and sprites every time
+    for (i = 0; i < 0x2000; i++) {
+        seed = seed * 1103515245 + 12345;
+        ctx->mem.vram[i] = (uint8_t)(seed >> 16);
+    }
+    for (i = 0; i < 0xA0; i++)
+        ctx->mem.oam[i] = ctx->mem.vram[i] % 168;
+
+    gbx_write_byte(ctx, 0xFF00 | PORT_BGP, 0xE4);
+    gbx_write_byte(ctx, 0xFF00 | PORT_OBP0, 0x1B);
+    gbx_write_byte(ctx, 0xFF00 | PORT_LCDC, 0x93);
+
+    gbx_execute_cycles(ctx, FRAMES * 70224);
+    gbx_get_framebuffer(ctx, dest);
+    gbx_destroy_context(ctx);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    static const struct { int format; const char *name; } formats[] = {
+        { GBX_PIXEL_BGRX8888,   "BGRX8888" },
+        { GBX_PIXEL_RGB888,     "RGB888" },
+        { GBX_PIXEL_BGR888,     "BGR888" },
+        { GBX_PIXEL_INDEX8,     "INDEX8" },
+        { GBX_PIXEL_PACKED2,    "PACKED2" },
+    };
+    static uint32_t expect[GBX_FB_SIZE], frame[GBX_FB_SIZE];
+    int i, p, failed = 0;
+
+    if (write_rom(ROM_PATH) || render_screen(GBX_PIXEL_RGBX8888, expect)) {
+        printf("unable to create a context\n");
+        return EXIT_FAILURE;
+    }
+
+    // only the color channels are compared, the 24-bit formats have no X
+    for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        memset(frame, 0, sizeof(frame));
+        if (render_screen(formats[i].format, frame)) {
+            printf("%s: unable to create a context\n", formats[i].name);
+            failed = 1;
+            continue;
+        }
+        for (p = 0; p < GBX_LCD_XRES * GBX_LCD_YRES; p++) {
+            if ((frame[p] ^ expect[p]) & 0x00FFFFFF) {
+                printf("%s: pixel %d,%d is %08x, expected %08x\n",
+                       formats[i].name, p % GBX_LCD_XRES, p / GBX_LCD_XRES,
+                       frame[p], expect[p]);
+                failed = 1;
+                break;
+            }
+        }
+    }
+
+    remove(ROM_PATH);
+
+    if (failed)
+        return EXIT_FAILURE;
+    printf("all formats match\n");
+    return EXIT_SUCCESS;
+}
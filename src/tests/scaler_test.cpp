@@ -0,0 +1,175 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "ImageScaler.h"
+
+// compares the software scalers against straightforward per-pixel versions,
+// at an integer and a non-integer scale. returns nonzero on any mismatch
+
+#define SRC_W   160
+#define SRC_H   144
+
+typedef std::vector<uint32_t> image_t;
+
+// ----------------------------------------------------------------------------
+static uint32_t Channel(uint32_t p, int i)
+{
+    return (p >> (i * 8)) & 0xFF;
+}
+
+// ----------------------------------------------------------------------------
+static void ReferenceNearest(const image_t &src, image_t &dst, int dw, int dh)
+{
+    for (int y = 0; y < dh; y++) {
+        for (int x = 0; x < dw; x++)
+            dst[y * dw + x] = src[(y * SRC_H / dh) * SRC_W + x * SRC_W / dw];
+    }
+}
+
+// ----------------------------------------------------------------------------
+static uint32_t Pixel(const image_t &src, int x, int y)
+{
+    x = MIN(MAX(x, 0), SRC_W - 1);
+    y = MIN(MAX(y, 0), SRC_H - 1);
+    return src[y * SRC_W + x];
+}
+
+// ----------------------------------------------------------------------------
+static void ReferenceScale2x(const image_t &src, image_t &dst)
+{
+    for (int y = 0; y < SRC_H; y++) {
+        for (int x = 0; x < SRC_W; x++) {
+            uint32_t B = Pixel(src, x, y - 1), H = Pixel(src, x, y + 1);
+            uint32_t D = Pixel(src, x - 1, y), F = Pixel(src, x + 1, y);
+            uint32_t E = Pixel(src, x, y), *d = &dst[y * 2 * SRC_W * 2 + x * 2];
+            bool edge = B != H && D != F;
+
+            d[0] = (edge && D == B) ? D : E;
+            d[1] = (edge && B == F) ? F : E;
+            d[SRC_W * 2] = (edge && D == H) ? D : E;
+            d[SRC_W * 2 + 1] = (edge && H == F) ? F : E;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+static double SampleAt(int i, int src_size, int dst_size)
+{
+    double pos = (i + 0.5) * src_size / dst_size - 0.5;
+    return MIN(MAX(pos, 0.0), src_size - 1.0);
+}
+
+// ----------------------------------------------------------------------------
+static void ReferenceBilinear(const image_t &src, image_t &dst, int dw, int dh)
+{
+    for (int y = 0; y < dh; y++) {
+        double v = SampleAt(y, SRC_H, dh), fy = v - floor(v);
+        for (int x = 0; x < dw; x++) {
+            double u = SampleAt(x, SRC_W, dw), fx = u - floor(u);
+            uint32_t p00 = Pixel(src, (int)u, (int)v);
+            uint32_t p10 = Pixel(src, (int)u + 1, (int)v);
+            uint32_t p01 = Pixel(src, (int)u, (int)v + 1);
+            uint32_t p11 = Pixel(src, (int)u + 1, (int)v + 1);
+            uint32_t out = 0;
+
+            for (int i = 0; i < 4; i++) {
+                double c = (Channel(p00, i) * (1 - fx) +
+                            Channel(p10, i) * fx) * (1 - fy) +
+                           (Channel(p01, i) * (1 - fx) +
+                            Channel(p11, i) * fx) * fy;
+                out |= (uint32_t)(c + 0.5) << (i * 8);
+            }
+            dst[y * dw + x] = out;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Count the pixels with any channel further than tolerance from the reference.
+static int Compare(const char *name, const image_t &out, const image_t &ref,
+                   int dw, int dh, int tolerance)
+{
+    int errors = 0;
+
+    for (int i = 0; i < dw * dh; i++) {
+        for (int c = 0; c < 4; c++) {
+            if (abs((int)Channel(out[i], c) - (int)Channel(ref[i], c)) >
+                tolerance) {
+                if (!errors++)
+                    fprintf(stderr, "%s %dx%d: first mismatch at %d,%d "
+                            "(%08X, expected %08X)\n", name, dw, dh,
+                            i % dw, i / dw, out[i], ref[i]);
+                break;
+            }
+        }
+    }
+
+    printf("%-8s %4dx%-4d %s\n", name, dw, dh, errors ? "FAIL" : "ok");
+    return errors;
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    static const int sizes[][2] = { { 640, 576 }, { 480, 432 }, { 333, 250 } };
+    static const uint32_t palette[4] = {
+        0xFF0F380F, 0xFF306230, 0xFF8BAC0F, 0xFF9BBC0F
+    };
+    image_t flat(SRC_W * SRC_H, 0xFF808080);
+    image_t tiles(SRC_W * SRC_H), ramp(SRC_W * SRC_H);
+    ImageScaler scaler;
+    int errors = 0;
+
+    // a few colors in blocks, so the scale2x rules actually fire, and a
+    // smooth ramp to show up any error in the bilinear weights
+    srand(1);
+    for (int i = 0; i < SRC_W * SRC_H; i++) {
+        int x = i % SRC_W, y = i / SRC_W;
+        tiles[i] = palette[((x / 3) * 7 + (y / 2) * 3 + rand() % 2) & 3];
+        ramp[i] = 0xFF000000 | ((x * 255 / (SRC_W - 1)) << 16) |
+                  ((y * 255 / (SRC_H - 1)) << 8) | ((x + y) & 0xFF);
+    }
+
+    for (unsigned n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+        int dw = sizes[n][0], dh = sizes[n][1];
+        image_t out(dw * dh), ref(dw * dh);
+
+        ImageScaler::Nearest(&tiles[0], SRC_W, SRC_H, &out[0], dw, dh);
+        ReferenceNearest(tiles, ref, dw, dh);
+        errors += Compare("nearest", out, ref, dw, dh, 0);
+
+        // fixed point weights are quantized to 1/256ths of a pixel
+        scaler.Bilinear(&flat[0], SRC_W, SRC_H, &out[0], dw, dh);
+        ReferenceBilinear(flat, ref, dw, dh);
+        errors += Compare("flat", out, ref, dw, dh, 0);
+
+        scaler.Bilinear(&ramp[0], SRC_W, SRC_H, &out[0], dw, dh);
+        ReferenceBilinear(ramp, ref, dw, dh);
+        errors += Compare("bilinear", out, ref, dw, dh, 2);
+    }
+
+    image_t out(SRC_W * SRC_H * 4), ref(SRC_W * SRC_H * 4);
+    ImageScaler::Scale2x(&tiles[0], SRC_W, SRC_H, &out[0]);
+    ReferenceScale2x(tiles, ref);
+    errors += Compare("scale2x", out, ref, SRC_W * 2, SRC_H * 2, 0);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
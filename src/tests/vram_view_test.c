@@ -0,0 +1,127 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gbx.h"
+#include "ports.h"
+
+// draws a known tile map with signed and unsigned tile codes, and checks that
+// bit 0 of the index selects the same tile data region in the tile and map
+// viewers. returns nonzero on any mismatch
+
+#define ROM_PATH    "vram_view_test.gb"
+#define ROM_SIZE    0x8000
+
+void ext_log_message(int level, const char *msg) { }
+void ext_video_sync(void *data) { }
+void ext_speed_change(void *data, int speed) { }
+void ext_lcd_enabled(void *data, int enabled) { }
+void ext_sound_frame(void *data) { }
+
+// ----------------------------------------------------------------------------
+static void fill_tile(gbx_context_t *ctx, int offset, int color)
+{
+    int i;
+
+    // every pixel of the tile gets the same color index
+    for (i = 0; i < 16; i += 2) {
+        ctx->mem.vram[offset + i] = (color & 1) ? 0xFF : 0x00;
+        ctx->mem.vram[offset + i + 1] = (color & 2) ? 0xFF : 0x00;
+    }
+}
+
+// ----------------------------------------------------------------------------
+static int write_rom(const char *path)
+{
+    static uint8_t rom[ROM_SIZE];
+    FILE *fp;
+
+    if (NULL == (fp = fopen(path, "wb")))
+        return -1;
+
+    // a blank rom only cart, enough to allocate the memory regions
+    fwrite(rom, 1, sizeof(rom), fp);
+    fclose(fp);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+static int check_map(const uint32_t *map, int index, uint32_t expect)
+{
+    int x, y;
+
+    for (y = 0; y < GBX_LCD_YRES; y++) {
+        for (x = 0; x < GBX_LCD_XRES; x++) {
+            if (map[y * GBX_LCD_XRES + x] != expect) {
+                printf("map %d: pixel %d,%d is %08x, expected %08x\n",
+                       index, x, y, map[y * GBX_LCD_XRES + x], expect);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    static uint32_t tiles[2][GBX_FB_SIZE], map[GBX_FB_SIZE];
+    uint32_t unsigned_pixel, signed_pixel;
+    gbx_context_t *ctx;
+    int index, failed = 0;
+
+    if (write_rom(ROM_PATH) || gbx_create_context(&ctx, SYSTEM_DMG) ||
+        gbx_load_file(ctx, ROM_PATH)) {
+        printf("unable to create a context\n");
+        return EXIT_FAILURE;
+    }
+    gbx_power_on(ctx);
+    gbx_write_byte(ctx, 0xFF00 | PORT_BGP, 0xE4);
+
+    // code 0x01 is the tile at 0x8010 when unsigned and 0x9010 when signed
+    memset(&ctx->mem.vram[0x1800], 0x01, 0x800);
+    fill_tile(ctx, 0x0010, 3);
+    fill_tile(ctx, 0x1010, 1);
+
+    // the same tiles in the tile viewer, as tile 0x01 of the region at 0x8000
+    // and tile 0x81 of the region at 0x8800
+    gbx_get_tile_buffer(ctx, tiles[0], 0);
+    gbx_get_tile_buffer(ctx, tiles[1], 1);
+    unsigned_pixel = tiles[0][8];
+    signed_pixel = tiles[1][64 * GBX_LCD_XRES + 8];
+    if (unsigned_pixel == signed_pixel) {
+        printf("tiles are drawn with the same color\n");
+        failed = 1;
+    }
+
+    // both maps, in the region selected by bit 0 of the index
+    for (index = 0; index < 4; index++) {
+        gbx_get_tmap_buffer(ctx, map, index);
+        if (check_map(map, index, (index & 1) ? signed_pixel : unsigned_pixel))
+            failed = 1;
+    }
+
+    gbx_destroy_context(ctx);
+    remove(ROM_PATH);
+
+    if (failed)
+        return EXIT_FAILURE;
+    printf("all tile maps match\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+
+#include <stdlib.h>
+#include "logging.h"
+#include "thread.h"
+
+typedef struct thread_start {
+    thread_func_t func;
+    void *arg;
+} thread_start_t;
+
+#ifdef PLATFORM_WIN32
+
+// ----------------------------------------------------------------------------
+static DWORD WINAPI thread_entry(LPVOID data)
+{
+    thread_start_t start = *(thread_start_t *)data;
+    free(data);
+    return (DWORD)start.func(start.arg);
+}
+
+// ----------------------------------------------------------------------------
+int thread_create(thread_t *thread, thread_func_t func, void *arg)
+{
+    thread_start_t *start = (thread_start_t *)malloc(sizeof(thread_start_t));
+    if (NULL == start)
+        return -1;
+
+    start->func = func;
+    start->arg = arg;
+
+    *thread = CreateThread(NULL, 0, thread_entry, start, 0, NULL);
+    if (NULL == *thread) {
+        log_err("unable to create thread (%lu)\n", GetLastError());
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+void thread_join(thread_t thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+// ----------------------------------------------------------------------------
+void mutex_init(mutex_t *mutex)     { InitializeCriticalSection(mutex); }
+void mutex_destroy(mutex_t *mutex)  { DeleteCriticalSection(mutex); }
+void mutex_lock(mutex_t *mutex)     { EnterCriticalSection(mutex); }
+void mutex_unlock(mutex_t *mutex)   { LeaveCriticalSection(mutex); }
+
+// ----------------------------------------------------------------------------
+void cond_init(cond_t *cond)        { InitializeConditionVariable(cond); }
+void cond_destroy(cond_t *cond)     { UNUSED_VARIABLE(cond); }
+void cond_broadcast(cond_t *cond)   { WakeAllConditionVariable(cond); }
+
+// ----------------------------------------------------------------------------
+void cond_wait(cond_t *cond, mutex_t *mutex)
+{
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+}
+
+#else
+
+// ----------------------------------------------------------------------------
+static void *thread_entry(void *data)
+{
+    thread_start_t start = *(thread_start_t *)data;
+    free(data);
+    return (void *)(size_t)start.func(start.arg);
+}
+
+// ----------------------------------------------------------------------------
+int thread_create(thread_t *thread, thread_func_t func, void *arg)
+{
+    thread_start_t *start = (thread_start_t *)malloc(sizeof(thread_start_t));
+    int rc;
+
+    if (NULL == start)
+        return -1;
+
+    start->func = func;
+    start->arg = arg;
+
+    if (0 != (rc = pthread_create(thread, NULL, thread_entry, start))) {
+        log_err("unable to create thread (%d)\n", rc);
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+void thread_join(thread_t thread)
+{
+    pthread_join(thread, NULL);
+}
+
+// ----------------------------------------------------------------------------
+void mutex_init(mutex_t *mutex)     { pthread_mutex_init(mutex, NULL); }
+void mutex_destroy(mutex_t *mutex)  { pthread_mutex_destroy(mutex); }
+void mutex_lock(mutex_t *mutex)     { pthread_mutex_lock(mutex); }
+void mutex_unlock(mutex_t *mutex)   { pthread_mutex_unlock(mutex); }
+
+// ----------------------------------------------------------------------------
+void cond_init(cond_t *cond)        { pthread_cond_init(cond, NULL); }
+void cond_destroy(cond_t *cond)     { pthread_cond_destroy(cond); }
+void cond_broadcast(cond_t *cond)   { pthread_cond_broadcast(cond); }
+
+// ----------------------------------------------------------------------------
+void cond_wait(cond_t *cond, mutex_t *mutex)
+{
+    pthread_cond_wait(cond, mutex);
+}
+
+#endif // PLATFORM_WIN32
+
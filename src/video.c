@@ -15,97 +15,534 @@
 // with this program; if not, write to the Free Software Foundation, Inc.,
 // 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
+#include <math.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include "gbx.h"
 #include "memory.h"
 #include "ports.h"
+#include "thread.h"
 #include "video.h"
 
+#if defined(SIMD_AVX2)
+#include <immintrin.h>
+#elif defined(SIMD_SSE2)
+#include <emmintrin.h>
+#endif
+
+static const uint32_t monochrome_colors[4] = {
+    0xFFFFFFFF, 0x80808080, 0x40404040, 0x00000000
+};
+
+// how the tile kernels combine objects with the background and window
+
+#define TILES_OBJ_HIDDEN    0   // objects disabled, tiles only
+#define TILES_OBJ_NORMAL    1   // per-pixel OBJ/BG priority
+#define TILES_OBJ_FORCED    2   // objects always drawn over tiles (CGB)
+
+// renders each completed frame while the emulator moves on to the next one
+
+typedef struct render_worker {
+    gbx_context_t *ctx;
+    thread_t thread;
+    mutex_t lock;
+    cond_t cond;                // signaled when pending or quit changes
+    render_job_t *pending;      // job handed over and not yet published
+    int quit;
+} render_worker_t;
+
 // ----------------------------------------------------------------------------
-void video_write_mono_palette(uint32_t *dest, uint8_t value)
+INLINE render_job_t *current_job(gbx_context_t *ctx)
 {
-    static const uint32_t monochrome_colors[4] = {
-        0xFFFFFFFF, 0x80808080, 0x40404040, 0x00000000
-    };
+    return &ctx->video.jobs[ctx->video.curr_job];
+}
+
+// ----------------------------------------------------------------------------
+static void wait_for_worker(gbx_context_t *ctx)
+{
+    render_worker_t *rw = ctx->video.worker;
+    if (!rw)
+        return;
 
-    dest[0] = monochrome_colors[(value >> 0) & 3];
-    dest[1] = monochrome_colors[(value >> 2) & 3];
-    dest[2] = monochrome_colors[(value >> 4) & 3];
-    dest[3] = monochrome_colors[(value >> 6) & 3];
+    // the output buffers belong to the worker until it publishes the frame
+    mutex_lock(&rw->lock);
+    while (rw->pending)
+        cond_wait(&rw->cond, &rw->lock);
+    mutex_unlock(&rw->lock);
 }
 
 // ----------------------------------------------------------------------------
-void video_write_lcdc(gbx_context_t *ctx, uint8_t value)
+INLINE uint32_t rgb_to_pixel(uint32_t rgb, int format)
 {
-    // if the LCD enable/disable state changes, inform the frontend
-    if ((ctx->video.lcdc ^ value) & LCDC_LCD_EN) {
-        ext_lcd_enabled(ctx->userdata, (value & LCDC_LCD_EN) ? 1 : 0);
+    switch (format) {
+    case GBX_PIXEL_BGRX8888:
+    case GBX_PIXEL_BGR888:
+        return (rgb & 0xFF00FF00) | ((rgb >> 16) & 0xFF) | ((rgb & 0xFF) << 16);
+    case GBX_PIXEL_RGB565:
+        return ((rgb & 0xF8) << 8) | ((rgb >> 5) & 0x7E0) |
+               ((rgb >> 19) & 0x1F);
+    default:
+        return rgb;
+    }
+}
 
-        // force reset of video state machine when if LCD disabled
-        if (!(value & LCDC_LCD_EN)) {
-            ctx->video.lcd_x = 0;
-            ctx->video.lcd_y = 0;
-            ctx->video.state = VIDEO_STATE_SEARCH;
-            ctx->video.cycle = 0;
+// ----------------------------------------------------------------------------
+static uint32_t color_profile_rgb(int profile, float gamma, uint16_t c)
+{
+    int r = c & 0x1F, g = (c >> 5) & 0x1F, b = (c >> 10) & 0x1F;
+
+    switch (profile) {
+    case GBX_COLOR_LCD:
+        // the CGB panel bleeds each channel into the others and never gets
+        // fully saturated, so mix the channels and compress their range
+        return (MIN(r * 26 + g * 4 + b * 2, 960) >> 2) |
+               ((MIN(g * 24 + b * 8, 960) >> 2) << 8) |
+               ((MIN(r * 6 + g * 4 + b * 22, 960) >> 2) << 16);
+    case GBX_COLOR_GAMMA:
+        return (int)(255.0 * pow(r / 31.0, gamma) + 0.5) |
+               ((int)(255.0 * pow(g / 31.0, gamma) + 0.5) << 8) |
+               ((int)(255.0 * pow(b / 31.0, gamma) + 0.5) << 16);
+    default:
+        return (r << 3) | (g << 11) | (b << 19);
+    }
+}
+
+// ----------------------------------------------------------------------------
+INLINE uint32_t cgb_palette_pixel(const uint32_t *lut, int format, int entry,
+                                  uint16_t color)
+{
+    // index formats store the palette entry itself rather than its color
+    if (video_is_indexed(format))
+        return entry;
+    return lut[color & 0x7FFF];
+}
+
+// ----------------------------------------------------------------------------
+static void track_line_changes(gbx_context_t *ctx, int y, const uint32_t *line)
+{
+    uint32_t *prev = ctx->video.line_prev[y];
+
+    // flag the scanline if it differs from the same line of the last frame
+    if (memcmp(prev, line, GBX_LCD_XRES * 4)) {
+        memcpy(prev, line, GBX_LCD_XRES * 4);
+        ctx->video.dirty[y >> 5] |= 1u << (y & 31);
+    }
+}
+
+// ----------------------------------------------------------------------------
+static void blend_line(gbx_context_t *ctx, int y, uint32_t *line)
+{
+    uint16_t *acc = &ctx->video.blend_acc[y * GBX_LCD_XRES * 4];
+    uint8_t *p = (uint8_t *)line;
+    int i, w = ctx->video.blend_weight;
+#if defined(SIMD_AVX2)
+    __m256i a0, a1, c0, c1;
+    __m256i prev = _mm256_set1_epi16((short)(w << 8));
+    __m256i curr = _mm256_set1_epi16((short)(256 - w));
+    __m256i half = _mm256_set1_epi16(128);
+#elif defined(SIMD_SSE2)
+    __m128i a0, a1, c;
+    __m128i zero = _mm_setzero_si128();
+    __m128i prev = _mm_set1_epi16((short)(w << 8));
+    __m128i curr = _mm_set1_epi16((short)(256 - w));
+    __m128i half = _mm_set1_epi16(128);
+#endif
+
+    // only formats with 8-bit channels can be mixed one byte at a time
+    if (!w || video_is_indexed(ctx->fb_format) ||
+        ctx->fb_format == GBX_PIXEL_RGB565)
+        return;
+
+    if (ctx->video.blend_reset) {
+        for (i = 0; i < GBX_LCD_XRES * 4; i++)
+            acc[i] = p[i] << 8;
+        return;
+    }
+
+    // acc = acc * w / 256 + p * (256 - w), then the output is acc rounded to
+    // the nearest integer. every path computes exactly the same values
+#if defined(SIMD_AVX2)
+    for (i = 0; i < GBX_LCD_XRES * 4; i += 32) {
+        c0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *)&p[i]));
+        c1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *)&p[i + 16]));
+        a0 = _mm256_loadu_si256((__m256i *)&acc[i]);
+        a1 = _mm256_loadu_si256((__m256i *)&acc[i + 16]);
+        a0 = _mm256_add_epi16(_mm256_mulhi_epu16(a0, prev),
+                              _mm256_mullo_epi16(c0, curr));
+        a1 = _mm256_add_epi16(_mm256_mulhi_epu16(a1, prev),
+                              _mm256_mullo_epi16(c1, curr));
+        _mm256_storeu_si256((__m256i *)&acc[i], a0);
+        _mm256_storeu_si256((__m256i *)&acc[i + 16], a1);
+
+        // packing works within each 128-bit lane, so restore the byte order
+        c0 = _mm256_packus_epi16(
+                _mm256_srli_epi16(_mm256_add_epi16(a0, half), 8),
+                _mm256_srli_epi16(_mm256_add_epi16(a1, half), 8));
+        c0 = _mm256_permute4x64_epi64(c0, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i *)&p[i], c0);
+    }
+#elif defined(SIMD_SSE2)
+    for (i = 0; i < GBX_LCD_XRES * 4; i += 16) {
+        c = _mm_loadu_si128((__m128i *)&p[i]);
+        a0 = _mm_loadu_si128((__m128i *)&acc[i]);
+        a1 = _mm_loadu_si128((__m128i *)&acc[i + 8]);
+        a0 = _mm_add_epi16(_mm_mulhi_epu16(a0, prev),
+                           _mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), curr));
+        a1 = _mm_add_epi16(_mm_mulhi_epu16(a1, prev),
+                           _mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), curr));
+        _mm_storeu_si128((__m128i *)&acc[i], a0);
+        _mm_storeu_si128((__m128i *)&acc[i + 8], a1);
+
+        c = _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(a0, half), 8),
+                             _mm_srli_epi16(_mm_add_epi16(a1, half), 8));
+        _mm_storeu_si128((__m128i *)&p[i], c);
+    }
+#else
+    for (i = 0; i < GBX_LCD_XRES * 4; i++) {
+        acc[i] = ((acc[i] * w) >> 8) + p[i] * (256 - w);
+        p[i] = (acc[i] + 128) >> 8;
+    }
+#endif
+}
+
+// ----------------------------------------------------------------------------
+void video_write_mono_palette(uint32_t *dest, uint8_t value, int format)
+{
+    int i, shade;
+
+    // index formats store the shade itself rather than its color
+    for (i = 0; i < 4; i++) {
+        shade = (value >> (i << 1)) & 3;
+        if (video_is_indexed(format))
+            dest[i] = shade;
+        else
+            dest[i] = rgb_to_pixel(monochrome_colors[shade], format);
+    }
+}
+
+// ----------------------------------------------------------------------------
+INLINE void convert_cgb_palettes(uint32_t *dest, const uint8_t *data,
+                                 const uint32_t *lut, int entry, int format)
+{
+    int i;
+    for (i = 0; i < 0x20; i++) {
+        uint16_t color = data[i << 1] | (data[(i << 1) | 1] << 8);
+        dest[i] = cgb_palette_pixel(lut, format, entry + i, color);
+    }
+}
+
+// ----------------------------------------------------------------------------
+INLINE void draw_tiles(render_state_t *rs, uint32_t *fb, int x, int end,
+                       int map, int bx, int by, const int cgb, const int objs)
+{
+    const uint8_t *ptile = &rs->vram[map + ((by & 0xF8) << 2)];
+    const obj_char_t *oam = (obj_char_t *)rs->oam;
+    const uint32_t *palette = rs->bgp_rgb;
+    const uint8_t *pcolor;
+    int tile = -1, off_x, off_y, ci, c1 = 0, c2 = 0, pri = 0, xflip = 0;
+    int sprite;
+
+    // cgb and objs are constant in each caller, so every variant below is
+    // compiled without the checks that do not apply to it
+    for (; x < end; x++, bx = (bx + 1) & 0xFF) {
+        if (objs == TILES_OBJ_FORCED && rs->line_obj[x] >= 0) {
+            // always render sprite if present and max priority given in LCDC
+            fb[x] = rs->line_col[x];
+            continue;
+        }
+
+        // fetch the tile row once for every eight pixels
+        if ((bx >> 3) != tile) {
+            tile = bx >> 3;
+            pcolor = rs->vram;
+            off_y = by & 7;
+
+            if (cgb) {
+                // read the background map attribute when in color mode
+                uint8_t attr = ptile[tile + VRAM_BANK_SIZE];
+                if (attr & BG_ATTR_BANK)
+                    pcolor += VRAM_BANK_SIZE;
+                if (attr & BG_ATTR_YFLIP)
+                    off_y = 7 - off_y;
+                pri = attr & BG_ATTR_PRI;
+                xflip = attr & BG_ATTR_XFLIP;
+                palette = &rs->bcpd_rgb[(attr & BG_ATTR_PAL) << 2];
+            }
+
+            // tile character data may be indexed from either 0x8000 or 0x8800
+            if (rs->lcdc & LCDC_BG_CHAR)
+                pcolor += (ptile[tile] << 4) + (off_y << 1);
+            else
+                pcolor += 0x1000 + ((int8_t)ptile[tile] << 4) + (off_y << 1);
+
+            c1 = pcolor[0];
+            c2 = pcolor[1];
         }
+
+        off_x = xflip ? (bx & 7) : 7 - (bx & 7);
+        ci = ((c1 >> off_x) & 1) | (((c2 >> off_x) << 1) & 2);
+
+        if (objs != TILES_OBJ_NORMAL) {
+            fb[x] = palette[ci];
+            continue;
+        }
+
+        // the sprite is drawn unless BG color 1-3 is given priority over it
+        sprite = rs->line_obj[x];
+        if (sprite < 0 || (ci && (pri || (oam[sprite].attr & OAM_ATTR_PRI))))
+            fb[x] = palette[ci];
+        else
+            fb[x] = rs->line_col[x];
     }
+}
+
+// ----------------------------------------------------------------------------
+static void draw_tiles_dmg(render_state_t *rs, uint32_t *fb, int x, int end,
+                           int map, int bx, int by)
+{
+    draw_tiles(rs, fb, x, end, map, bx, by, 0, TILES_OBJ_HIDDEN);
+}
+
+// ----------------------------------------------------------------------------
+static void draw_tiles_dmg_obj(render_state_t *rs, uint32_t *fb, int x,
+                               int end, int map, int bx, int by)
+{
+    draw_tiles(rs, fb, x, end, map, bx, by, 0, TILES_OBJ_NORMAL);
+}
+
+// ----------------------------------------------------------------------------
+static void draw_tiles_dmg_pri(render_state_t *rs, uint32_t *fb, int x,
+                               int end, int map, int bx, int by)
+{
+    draw_tiles(rs, fb, x, end, map, bx, by, 0, TILES_OBJ_FORCED);
+}
+
+// ----------------------------------------------------------------------------
+static void draw_tiles_cgb(render_state_t *rs, uint32_t *fb, int x, int end,
+                           int map, int bx, int by)
+{
+    draw_tiles(rs, fb, x, end, map, bx, by, 1, TILES_OBJ_HIDDEN);
+}
+
+// ----------------------------------------------------------------------------
+static void draw_tiles_cgb_obj(render_state_t *rs, uint32_t *fb, int x,
+                               int end, int map, int bx, int by)
+{
+    draw_tiles(rs, fb, x, end, map, bx, by, 1, TILES_OBJ_NORMAL);
+}
+
+// ----------------------------------------------------------------------------
+static void draw_tiles_cgb_pri(render_state_t *rs, uint32_t *fb, int x,
+                               int end, int map, int bx, int by)
+{
+    draw_tiles(rs, fb, x, end, map, bx, by, 1, TILES_OBJ_FORCED);
+}
+
+// ----------------------------------------------------------------------------
+static void select_tile_kernel(render_state_t *rs)
+{
+    static void (* const kernels[2][3])(render_state_t *, uint32_t *, int,
+                                        int, int, int, int) = {
+        { draw_tiles_dmg, draw_tiles_dmg_obj, draw_tiles_dmg_pri },
+        { draw_tiles_cgb, draw_tiles_cgb_obj, draw_tiles_cgb_pri },
+    };
+    int objs = TILES_OBJ_HIDDEN;
+
+    if (rs->obj_pri)
+        objs = TILES_OBJ_FORCED;
+    else if (rs->show_obj)
+        objs = TILES_OBJ_NORMAL;
+
+    rs->draw_tiles = kernels[rs->color_enabled ? 1 : 0][objs];
+}
 
+// ----------------------------------------------------------------------------
+static void render_write_lcdc(render_state_t *rs, uint8_t value)
+{
     // determine if window tile map is located at 9C00 or 9800
-    if (value & LCDC_WND_CODE)
-        ctx->video.wnd_code = &ctx->mem.vram[0x1C00];
-    else
-        ctx->video.wnd_code = &ctx->mem.vram[0x1800];
+    rs->wnd_code = (value & LCDC_WND_CODE) ? 0x1C00 : 0x1800;
 
     // determine if background tile map is located at 9C00 or 9800
-    if (value & LCDC_BG_CODE)
-        ctx->video.bg_code = &ctx->mem.vram[0x1C00];
-    else
-        ctx->video.bg_code = &ctx->mem.vram[0x1800];
+    rs->bg_code = (value & LCDC_BG_CODE) ? 0x1C00 : 0x1800;
+
+    // the sprite scanline index depends on the object height, so rebuild it
+    if ((rs->lcdc ^ value) & LCDC_OBJ_SIZE)
+        rs->obj_index_valid = 0;
 
     if (value & LCDC_OBJ_SIZE) {
-        ctx->video.sprite_hmax = 15;
-        ctx->video.sprite_mask = 0xFE;
+        rs->sprite_hmax = 15;
+        rs->sprite_mask = 0xFE;
     }
     else {
-        ctx->video.sprite_hmax = 7;
-        ctx->video.sprite_mask = 0xFF;
+        rs->sprite_hmax = 7;
+        rs->sprite_mask = 0xFF;
     }
 
     // set all layers to enabled and standard priority, then alter below...
-    ctx->video.show_bg = ctx->video.show_wnd = ctx->video.show_obj = 1;
-    ctx->video.obj_pri = 0;
+    rs->show_bg = rs->show_wnd = rs->show_obj = 1;
+    rs->obj_pri = 0;
 
     if (!(value & LCDC_OBJ_EN))
-        ctx->video.show_obj = 0;
+        rs->show_obj = 0;
 
     if (!(value & LCDC_WND_EN))
-        ctx->video.show_wnd = 0;
+        rs->show_wnd = 0;
 
     // BG_EN is odd in that its behavior depends on the system type and whether
     // we're running in color or monochrome mode, and may override other bits
 
     if (!(value & LCDC_BG_EN)) {
-        if (ctx->system == SYSTEM_CGB) {
-            if (ctx->color_enabled) {
+        if (rs->system == SYSTEM_CGB) {
+            if (rs->color_enabled) {
                 // CGB in color mode -- set object priority over BG and window
                 // keep unset if objects are disabled
-                ctx->video.obj_pri = ctx->video.show_obj;
+                rs->obj_pri = rs->show_obj;
             }
             else {
                 // CGB in monochrome mode -- disable BG and window layer
                 // note that the WND_EN bit is overridden in this case
-                ctx->video.show_bg = 0;
-                ctx->video.show_wnd = 0;
+                rs->show_bg = 0;
+                rs->show_wnd = 0;
             }
         }
         else {
             // non-CGB / monochrome system -- only disable the BG layer
-            ctx->video.show_bg = 0;
+            rs->show_bg = 0;
         }
     }
 
+    rs->lcdc = value;
+    select_tile_kernel(rs);
+}
+
+// ----------------------------------------------------------------------------
+static void render_set_format(render_state_t *rs, int format, uint32_t black)
+{
+    const uint32_t *lut = rs->color_lut;
+    rs->format = format;
+    convert_cgb_palettes(rs->bcpd_rgb, rs->bcpd, lut, 0, format);
+    convert_cgb_palettes(rs->ocpd_rgb, rs->ocpd, lut, GBX_INDEX_OBJ, format);
+    video_write_mono_palette(rs->bgp_rgb, rs->bgp, format);
+    video_write_mono_palette(rs->obp0_rgb, rs->obp0, format);
+    video_write_mono_palette(rs->obp1_rgb, rs->obp1, format);
+    rs->black = black;
+}
+
+// ----------------------------------------------------------------------------
+static void begin_frame(gbx_context_t *ctx)
+{
+    render_job_t *job = current_job(ctx);
+    render_state_t *rs = &job->rs;
+
+    // snapshot the state the first scanline is drawn from, anything written
+    // after this point is journaled until the frame is complete
+    memcpy(rs->vram, ctx->mem.vram, ctx->mem.vram_banks * VRAM_BANK_SIZE);
+    memcpy(rs->oam, ctx->mem.oam, sizeof(rs->oam));
+    memcpy(rs->bcpd, ctx->video.bcpd, sizeof(rs->bcpd));
+    memcpy(rs->ocpd, ctx->video.ocpd, sizeof(rs->ocpd));
+    memcpy(rs->bcpd_rgb, ctx->video.bcpd_rgb, sizeof(rs->bcpd_rgb));
+    memcpy(rs->ocpd_rgb, ctx->video.ocpd_rgb, sizeof(rs->ocpd_rgb));
+    memcpy(rs->bgp_rgb, ctx->video.bgp_rgb, sizeof(rs->bgp_rgb));
+    memcpy(rs->obp0_rgb, ctx->video.obp0_rgb, sizeof(rs->obp0_rgb));
+    memcpy(rs->obp1_rgb, ctx->video.obp1_rgb, sizeof(rs->obp1_rgb));
+
+    rs->format = ctx->fb_format;
+    rs->color_lut = ctx->video.color_lut;
+    rs->system = ctx->system;
+    rs->color_enabled = ctx->color_enabled;
+    rs->black = ctx->video.black;
+    rs->scx = ctx->video.scx;
+    rs->scy = ctx->video.scy;
+    rs->wx = ctx->video.wx;
+    rs->wy = ctx->video.wy;
+    rs->curr_wy = 0;
+    rs->bgp = ctx->video.bgp;
+    rs->obp0 = ctx->video.obp0;
+    rs->obp1 = ctx->video.obp1;
+    render_write_lcdc(rs, ctx->video.lcdc);
+    rs->obj_index_valid = 0;
+
+    job->write_count = 0;
+    job->prep_dot[0] = 0;
+    ctx->video.dot = 0;
+    ctx->video.frame_open = 1;
+}
+
+// ----------------------------------------------------------------------------
+void video_journal_write(gbx_context_t *ctx, int type, int target,
+                         uint8_t value)
+{
+    render_job_t *job = current_job(ctx);
+    video_write_t *w;
+
+    // writes made outside of a frame are picked up by the next snapshot
+    if (!ctx->video.frame_open)
+        return;
+
+    if (job->write_count >= job->write_size) {
+        int size = job->write_size ? job->write_size << 1 : 1024;
+        w = (video_write_t *)realloc(job->writes, size * sizeof(*w));
+        if (!w) {
+            log_err("unable to grow the video write journal\n");
+            return;
+        }
+        job->writes = w;
+        job->write_size = size;
+    }
+
+    w = &job->writes[job->write_count++];
+    w->dot = ctx->video.dot;
+    w->target = target;
+    w->type = type;
+    w->value = value;
+}
+
+// ----------------------------------------------------------------------------
+void video_write_lcdc(gbx_context_t *ctx, uint8_t value)
+{
+    int enabled = (value & ~ctx->video.lcdc) & LCDC_LCD_EN;
+    uint32_t white;
+    int x, y;
+
+    // if the LCD enable/disable state changes, inform the frontend
+    if ((ctx->video.lcdc ^ value) & LCDC_LCD_EN) {
+        ext_lcd_enabled(ctx->userdata, (value & LCDC_LCD_EN) ? 1 : 0);
+
+        // force reset of video state machine when if LCD disabled
+        if (!(value & LCDC_LCD_EN)) {
+            ctx->video.lcd_x = 0;
+            ctx->video.lcd_y = 0;
+            ctx->video.state = VIDEO_STATE_SEARCH;
+            ctx->video.cycle = 0;
+
+            // the partially drawn frame is never displayed
+            ctx->video.frame_open = 0;
+            wait_for_worker(ctx);
+
+            // a disabled LCD displays solid white until it is re-enabled
+            if (!video_is_indexed(ctx->fb_format))
+                white = rgb_to_pixel(monochrome_colors[0], ctx->fb_format);
+            else
+                white = ctx->color_enabled ? GBX_INDEX_WHITE : 0;
+
+            for (y = 0; y < GBX_LCD_YRES; y++) {
+                for (x = 0; x < GBX_LCD_XRES; x++)
+                    ctx->video.line_buf[x] = white;
+                blend_line(ctx, y, ctx->video.line_buf);
+                track_line_changes(ctx, y, ctx->video.line_buf);
+                video_commit_line(ctx, y, ctx->video.line_buf);
+            }
+            video_publish_frame(ctx, ctx->cycles);
+        }
+    }
+
+    video_journal_write(ctx, VIDEO_WRITE_PORT, PORT_LCDC, value);
     ctx->video.lcdc = value;
+
+    // once re-enabled, the LCD starts a new frame from the top of the screen
+    if (enabled && ctx->video.state == VIDEO_STATE_SEARCH)
+        begin_frame(ctx);
 }
 
 // ----------------------------------------------------------------------------
@@ -119,7 +556,10 @@ void video_write_bcpd(gbx_context_t *ctx, uint8_t value)
 
     ctx->video.bcpd[index] = value;
     color = ctx->video.bcpd[index & ~1] | (ctx->video.bcpd[index | 1] << 8);
-    ctx->video.bcpd_rgb[index >> 1] = cgb_color_to_rgb(color);
+    ctx->video.bcpd_rgb[index >> 1] =
+        cgb_palette_pixel(ctx->video.color_lut, ctx->fb_format, index >> 1,
+                          color);
+    video_journal_write(ctx, VIDEO_WRITE_BCPD, index, value);
 
     // if flag is set, auto increment the palette specification index by one
     if (ctx->video.bcps & CPS_INCREMENT)
@@ -136,10 +576,13 @@ void video_write_ocpd(gbx_context_t *ctx, uint8_t value)
         return;
     }
 
-    // store the color in both 16-bit CGB format and 32-bit ARGB
+    // store the color in both 16-bit CGB format and the output pixel format
     ctx->video.ocpd[index] = value;
     color = ctx->video.ocpd[index & ~1] | (ctx->video.ocpd[index | 1] << 8);
-    ctx->video.ocpd_rgb[index >> 1] = cgb_color_to_rgb(color);
+    ctx->video.ocpd_rgb[index >> 1] =
+        cgb_palette_pixel(ctx->video.color_lut, ctx->fb_format,
+                          GBX_INDEX_OBJ + (index >> 1), color);
+    video_journal_write(ctx, VIDEO_WRITE_OCPD, index, value);
 
     // if flag is set, auto increment the palette specification index by one
     if (ctx->video.ocps & CPS_INCREMENT)
@@ -252,23 +695,50 @@ uint8_t video_read_stat(gbx_context_t *ctx)
 }
 
 // ----------------------------------------------------------------------------
-INLINE void commit_sprite_color(gbx_context_t *ctx, int sprite, int x, int y)
+static void build_sprite_index(render_state_t *rs)
 {
-    obj_char_t *obj = &((obj_char_t *)ctx->mem.oam)[sprite];
-    uint32_t *palette = ctx->video.bgp_rgb;
-    int ci, c1, c2, addr;
-    
-    int code = obj->code & ctx->video.sprite_mask;
-    int off_x = x - obj->xpos + 8;
+    obj_char_t *obj = (obj_char_t *)rs->oam;
+    int height = (rs->lcdc & LCDC_OBJ_SIZE) ? 16 : 8;
+    int sprite, line, first, last;
+
+    memset(rs->obj_count, 0, sizeof(rs->obj_count));
+
+    // OAM search selects sprites by Y coordinate alone, in OAM order, and stops
+    // after the first ten on each line (even if they are off-screen in X)
+    for (sprite = 0; sprite < OAM_SPRITE_COUNT; ++sprite) {
+        first = MAX(obj[sprite].ypos - 16, 0);
+        last = MIN(obj[sprite].ypos - 16 + height, LCD_SCANLINE_COUNT);
+
+        for (line = first; line < last; ++line) {
+            uint8_t count = rs->obj_count[line];
+            if (count < LCD_SPRITES_PER_LINE) {
+                rs->obj_index[line][count] = sprite;
+                rs->obj_count[line] = count + 1;
+            }
+        }
+    }
+
+    rs->obj_index_valid = 1;
+}
+
+// ----------------------------------------------------------------------------
+static void commit_sprite_line(render_state_t *rs, int sprite, int y)
+{
+    obj_char_t *oam = (obj_char_t *)rs->oam, *obj = &oam[sprite];
+    uint32_t *palette;
+    int *line = rs->line_obj;
+    int x, old, ci, c1, c2, addr, off_x;
+
+    int code = obj->code & rs->sprite_mask;
+    int xpos = obj->xpos - 8;
     int off_y = y - obj->ypos + 16;
 
-    // determine the orientation (normal, xflip, yflip, xflip & yflip)
-    if (!(obj->attr & OAM_ATTR_XFLIP)) off_x = 7 - off_x;
-    if (obj->attr & OAM_ATTR_YFLIP) off_y = ctx->video.sprite_hmax - off_y;
+    // determine the vertical orientation (normal or yflip)
+    if (obj->attr & OAM_ATTR_YFLIP) off_y = rs->sprite_hmax - off_y;
 
-    if (ctx->color_enabled) {
+    if (rs->color_enabled) {
         // select the palette base address (OBP0-7)
-        palette = &ctx->video.ocpd_rgb[(obj->attr & OAM_ATTR_CPAL) << 2];
+        palette = &rs->ocpd_rgb[(obj->attr & OAM_ATTR_CPAL) << 2];
 
         // select the tile data from either VRAM bank 0 or bank 1
         if (obj->attr & OAM_ATTR_BANK)
@@ -279,138 +749,446 @@ INLINE void commit_sprite_color(gbx_context_t *ctx, int sprite, int x, int y)
     else {
         // monochrome mode: select from either OBP0 or OBP1
         if (obj->attr & OAM_ATTR_PAL)
-            palette = ctx->video.obp1_rgb;
+            palette = rs->obp1_rgb;
         else
-            palette = ctx->video.obp0_rgb;
+            palette = rs->obp0_rgb;
 
         // tile data located in the first (and only) VRAM bank
         addr = (code << 4) + (off_y << 1);
     }
 
-    c1 = ctx->mem.vram[addr + 0];
-    c2 = ctx->mem.vram[addr + 1];
-    ci = ((c1 >> off_x) & 1) | (((c2 >> off_x) << 1) & 2);
+    // the tile row is identical for each of the sprite's eight columns
+    c1 = rs->vram[addr + 0];
+    c2 = rs->vram[addr + 1];
+
+    for (x = MAX(xpos, 0); x < MIN(xpos + 8, GBX_LCD_XRES); x++) {
+        old = line[x];
+        if (old >= 0) {
+            // lowest OBJ index always taken on CGB regardless of X coord
+            if (oam[old].xpos == obj->xpos || rs->color_enabled)
+                continue;
+
+            // for DMG (or DMG mode), however, take the lowest x coord
+            if (oam[old].xpos < obj->xpos)
+                continue;
+        }
+
+        // determine the horizontal orientation (normal or xflip)
+        off_x = x - xpos;
+        if (!(obj->attr & OAM_ATTR_XFLIP)) off_x = 7 - off_x;
 
-    if (ci) {
-        ctx->video.line_obj[x] = sprite;
-        ctx->video.line_col[x] = palette[ci];
+        // only assign the sprite to this column if its not transparent
+        ci = ((c1 >> off_x) & 1) | (((c2 >> off_x) << 1) & 2);
+        if (ci) {
+            line[x] = sprite;
+            rs->line_col[x] = palette[ci];
+        }
     }
 }
 
 // ----------------------------------------------------------------------------
-static void prepare_line_buffer(gbx_context_t *ctx)
+static void prepare_line_buffer(render_state_t *rs, int curr_line)
 {
-    obj_char_t *obj = (obj_char_t *)ctx->mem.oam;
-    int *line = ctx->video.line_obj;
-    int height = (ctx->video.lcdc & LCDC_OBJ_SIZE) ? 16 : 8;
-    int old, xpos, ypos, x, sprite, curr_line = ctx->video.lcd_y;
+    uint8_t *sprites;
+    int i;
 
     // clear the object line buffer, any index < 0 considered uninitialized
-    memset(line, 0xFF, sizeof(int) * GBX_LCD_XRES);
+    memset(rs->line_obj, 0xFF, sizeof(int) * GBX_LCD_XRES);
 
-    for (sprite = 0; sprite < 40; ++sprite) {
-        // skip this sprite if it doesn't touch any pixels on the current line
-        ypos = obj[sprite].ypos - 16;
-        if (curr_line < ypos || curr_line >= (ypos + height))
-            continue;
-        
-        xpos = obj[sprite].xpos - 8;
-        for (x = xpos; x < xpos + 8; x++) {
-            // obviously skip if the current sprite pixel is not on the screen
-            if (x < 0 || x >= GBX_LCD_XRES)
-                continue;
+    // rebuild the sprite scanline index only after OAM has been modified
+    if (!rs->obj_index_valid)
+        build_sprite_index(rs);
 
-            old = line[x];
-            if (old >= 0) {
-                // lowest OBJ index always taken on CGB regardless of X coord
-                if (obj[old].xpos == obj[sprite].xpos || ctx->color_enabled)
-                    continue;
+    // visit only the sprites that touch this line, lowest OAM index first
+    sprites = rs->obj_index[curr_line];
+    for (i = 0; i < rs->obj_count[curr_line]; ++i)
+        commit_sprite_line(rs, sprites[i], curr_line);
+}
 
-                // for DMG (or DMG mode), however, take the lowest x coord
-                if (obj[old].xpos < obj[sprite].xpos)
-                    continue;
-            }
+// ----------------------------------------------------------------------------
+static void render_span(render_state_t *rs, uint32_t *fb, int x, int end,
+                        int y)
+{
+    int i, wnd_x = end;
+
+    // the window covers everything right of WX, once LY has reached WY
+    if (rs->show_wnd && y >= rs->wy)
+        wnd_x = MAX(x, MIN(rs->wx, end));
 
-            // only assign the sprite to this column if its not transparent
-            commit_sprite_color(ctx, sprite, x, curr_line);
+    if (x < wnd_x) {
+        if (rs->show_bg) {
+            rs->draw_tiles(rs, fb, x, wnd_x, rs->bg_code,
+                           (x + rs->scx) & 0xFF, (y + rs->scy) & 0xFF);
         }
+        else {
+            // neither background nor window, only sprites are displayed
+            for (i = x; i < wnd_x; i++)
+                fb[i] = rs->line_obj[i] > 0 ? rs->line_col[i] : rs->black;
+        }
+    }
+
+    if (wnd_x < end) {
+        rs->draw_tiles(rs, fb, wnd_x, end, rs->wnd_code,
+                       wnd_x - rs->wx, rs->curr_wy);
+
+        // the window line only advances on lines where it was displayed
+        if (end == GBX_LCD_XRES)
+            rs->curr_wy++;
+    }
+}
+
+// ----------------------------------------------------------------------------
+static void render_write_port(render_state_t *rs, int port, uint8_t value)
+{
+    switch (port) {
+    case PORT_LCDC:
+        render_write_lcdc(rs, value);
+        break;
+    case PORT_SCY:
+        rs->scy = value;
+        break;
+    case PORT_SCX:
+        rs->scx = value;
+        break;
+    case PORT_BGP:
+        rs->bgp = value;
+        video_write_mono_palette(rs->bgp_rgb, value, rs->format);
+        break;
+    case PORT_OBP0:
+        rs->obp0 = value;
+        video_write_mono_palette(rs->obp0_rgb, value, rs->format);
+        break;
+    case PORT_OBP1:
+        rs->obp1 = value;
+        video_write_mono_palette(rs->obp1_rgb, value, rs->format);
+        break;
+    case PORT_WY:
+        rs->wy = value;
+        break;
+    case PORT_WX:
+        rs->wx = value - 7;
+        break;
     }
 }
 
 // ----------------------------------------------------------------------------
-static void video_render_pixel(gbx_context_t *ctx, int x, int y)
+static void render_apply_write(render_state_t *rs, const video_write_t *w)
 {
-    const int fb_pos = y * GBX_LCD_XRES + x;
-    int base_x, base_y, off_x, off_y, ci, bg_max_pri = 0;
-    uint8_t *ptile, *pcolor = ctx->mem.vram;
-    uint32_t *palette = ctx->video.bgp_rgb;
-    int sprite = ctx->video.line_obj[x];
+    int index = w->target;
+    uint16_t color;
 
-    if (sprite >= 0) {
-        obj_char_t *obj = &((obj_char_t *)ctx->mem.oam)[sprite];
-        if (ctx->video.obj_pri) {
-            // always render sprite if present and max priority given in LCDC
-            ctx->fb[fb_pos] = ctx->video.line_col[x];
-            return;
+    switch (w->type) {
+    case VIDEO_WRITE_VRAM:
+        rs->vram[index] = w->value;
+        break;
+    case VIDEO_WRITE_OAM:
+        rs->oam[index] = w->value;
+        rs->obj_index_valid = 0;
+        break;
+    case VIDEO_WRITE_PORT:
+        render_write_port(rs, index, w->value);
+        break;
+    case VIDEO_WRITE_BCPD:
+        rs->bcpd[index] = w->value;
+        color = rs->bcpd[index & ~1] | (rs->bcpd[index | 1] << 8);
+        rs->bcpd_rgb[index >> 1] =
+            cgb_palette_pixel(rs->color_lut, rs->format, index >> 1, color);
+        break;
+    case VIDEO_WRITE_OCPD:
+        rs->ocpd[index] = w->value;
+        color = rs->ocpd[index & ~1] | (rs->ocpd[index | 1] << 8);
+        rs->ocpd_rgb[index >> 1] = cgb_palette_pixel(rs->color_lut,
+                rs->format, GBX_INDEX_OBJ + (index >> 1), color);
+        break;
+    case VIDEO_WRITE_COLOR:
+        rs->color_enabled = w->value;
+        select_tile_kernel(rs);
+        break;
+    }
+}
+
+// ----------------------------------------------------------------------------
+static void render_frame(gbx_context_t *ctx, render_job_t *job)
+{
+    render_state_t *rs = &job->rs;
+    video_write_t *w = job->writes, *end = w + job->write_count;
+    uint32_t *line = ctx->video.line_buf;
+    int x, y, next;
+
+    for (y = 0; y < GBX_LCD_YRES; y++) {
+        // apply the writes made before the OAM search for this line
+        for (; w < end && w->dot <= job->prep_dot[y]; ++w)
+            render_apply_write(rs, w);
+        prepare_line_buffer(rs, y);
+
+        // pixel x is drawn on cycle xfer_dot + x, after any write stamped with
+        // that cycle or an earlier one
+        for (x = 0; x < GBX_LCD_XRES; x = next) {
+            for (; w < end && w->dot <= job->xfer_dot[y] + x; ++w)
+                render_apply_write(rs, w);
+
+            next = GBX_LCD_XRES;
+            if (w < end && w->dot - job->xfer_dot[y] < GBX_LCD_XRES)
+                next = w->dot - job->xfer_dot[y];
+
+            render_span(rs, line, x, next, y);
         }
-        else if (obj->attr & OAM_ATTR_PRI) {
-            // even if not set here, OBJ priority may be overriden by BG attr
-            bg_max_pri = 1;
+
+        // lines are blended and compared before they are stored, since the
+        // frame may be write-only memory that is very slow to read back
+        blend_line(ctx, y, line);
+        track_line_changes(ctx, y, line);
+        video_commit_line(ctx, y, line);
+    }
+}
+
+// ----------------------------------------------------------------------------
+void video_commit_line(gbx_context_t *ctx, int y, const uint32_t *src)
+{
+    uint8_t *dest = ctx->fb_draw + y * ctx->fb_pitch;
+    int x;
+
+    // palettes are already in the output format, so the pixels only need to
+    // be narrowed to the size of the destination
+    switch (ctx->fb_format) {
+    case GBX_PIXEL_RGB888:
+    case GBX_PIXEL_BGR888:
+        for (x = 0; x < GBX_LCD_XRES; x++, dest += 3) {
+            dest[0] = (uint8_t)(src[x] >> 0);
+            dest[1] = (uint8_t)(src[x] >> 8);
+            dest[2] = (uint8_t)(src[x] >> 16);
         }
+        break;
+    case GBX_PIXEL_RGB565:
+        for (x = 0; x < GBX_LCD_XRES; x++)
+            ((uint16_t *)dest)[x] = (uint16_t)src[x];
+        break;
+    case GBX_PIXEL_INDEX8:
+        for (x = 0; x < GBX_LCD_XRES; x++)
+            dest[x] = (uint8_t)src[x];
+        break;
+    case GBX_PIXEL_PACKED2:
+        for (x = 0; x < GBX_LCD_XRES; x += 4, src += 4) {
+            *dest++ = ((src[0] & 3) << 6) | ((src[1] & 3) << 4) |
+                      ((src[2] & 3) << 2) | (src[3] & 3);
+        }
+        break;
+    default:
+        memcpy(dest, src, GBX_LCD_XRES * 4);
+        break;
     }
+}
 
-    // if obj_pri is NOT set, need to evalulate both BG and OBJ priority
-    if (ctx->video.show_wnd && x >= ctx->video.wx && y >= ctx->video.wy) {
-        base_x = x - ctx->video.wx;
-        base_y = ctx->video.curr_wy;
-        if (x == GBX_LCD_XRES-1) ctx->video.curr_wy++;
-        ptile = &ctx->video.wnd_code[((base_y & 0xF8) << 2) | (base_x >> 3)];
+// ----------------------------------------------------------------------------
+void video_publish_frame(gbx_context_t *ctx, long cycles)
+{
+    gbx_frame_t *slot = &ctx->fb_slot[ctx->fb_back];
+    slot->pixels = ctx->fb_draw;
+    slot->pitch = ctx->fb_pitch;
+    slot->format = ctx->fb_format;
+    slot->seq = ctx->frame_count++;
+    slot->cycles = cycles;
+
+    if (ctx->video.dirty_all)
+        memset(slot->dirty, 0xFF, sizeof(slot->dirty));
+    else
+        memcpy(slot->dirty, ctx->video.dirty, sizeof(slot->dirty));
+
+    memset(ctx->video.dirty, 0, sizeof(ctx->video.dirty));
+    ctx->video.dirty_all = 0;
+    ctx->video.blend_reset = 0;
+
+    // hand the finished frame to the display thread and reclaim whichever
+    // buffer it isn't using. a frame that was never acquired is dropped
+    ctx->fb_back = ATOMIC_XCHG(&ctx->fb_ready, ctx->fb_back | FB_FRESH);
+    ctx->fb_back &= FB_INDEX;
+    ctx->fb_draw = ctx->fb_base[ctx->fb_back];
+}
+
+// ----------------------------------------------------------------------------
+static int render_worker_run(void *data)
+{
+    render_worker_t *rw = (render_worker_t *)data;
+    render_job_t *job;
+
+    mutex_lock(&rw->lock);
+    while (!rw->quit) {
+        if (!rw->pending) {
+            cond_wait(&rw->cond, &rw->lock);
+            continue;
+        }
+
+        // the emulator records into the other job while this one is drawn
+        job = rw->pending;
+        mutex_unlock(&rw->lock);
+
+        render_frame(rw->ctx, job);
+        video_publish_frame(rw->ctx, job->cycles);
+
+        mutex_lock(&rw->lock);
+        rw->pending = NULL;
+        cond_broadcast(&rw->cond);
     }
-    else if (ctx->video.show_bg) {
-        base_x = (x + ctx->video.scx) & 0xFF;
-        base_y = (y + ctx->video.scy) & 0xFF;
-        ptile = &ctx->video.bg_code[((base_y & 0xF8) << 2) | (base_x >> 3)];
+    mutex_unlock(&rw->lock);
+
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+static void submit_render_job(gbx_context_t *ctx)
+{
+    render_worker_t *rw = ctx->video.worker;
+
+    // wait for the previous frame, so delivery is at most one frame behind
+    mutex_lock(&rw->lock);
+    while (rw->pending)
+        cond_wait(&rw->cond, &rw->lock);
+
+    rw->pending = current_job(ctx);
+    cond_broadcast(&rw->cond);
+    mutex_unlock(&rw->lock);
+
+    ctx->video.curr_job ^= 1;
+}
+
+// ----------------------------------------------------------------------------
+int gbx_set_render_thread(gbx_context_t *ctx, int enable)
+{
+    render_worker_t *rw;
+    assert(NULL != ctx);
+
+    rw = ctx->video.worker;
+    if (!enable == !rw)
+        return 0;
+
+    if (!enable) {
+        // let the worker publish the frame it holds before stopping it
+        wait_for_worker(ctx);
+        mutex_lock(&rw->lock);
+        rw->quit = 1;
+        cond_broadcast(&rw->cond);
+        mutex_unlock(&rw->lock);
+
+        thread_join(rw->thread);
+        cond_destroy(&rw->cond);
+        mutex_destroy(&rw->lock);
+        SAFE_FREE(ctx->video.worker);
+        return 0;
     }
-    else {
-        ctx->fb[fb_pos] = sprite > 0 ? ctx->video.line_col[x] : 0;
-        return;
+
+    if (NULL == (rw = (render_worker_t *)calloc(1, sizeof(render_worker_t))))
+        return -1;
+
+    rw->ctx = ctx;
+    mutex_init(&rw->lock);
+    cond_init(&rw->cond);
+
+    if (thread_create(&rw->thread, render_worker_run, rw)) {
+        log_err("unable to start the render thread\n");
+        cond_destroy(&rw->cond);
+        mutex_destroy(&rw->lock);
+        free(rw);
+        return -1;
     }
 
-    off_x = 7 - (base_x & 7);
-    off_y = base_y & 7;
+    ctx->video.worker = rw;
+    return 0;
+}
 
-    if (ctx->color_enabled) {
-        // read the background map attribute when operating in color mode
-        uint8_t attr = *(ptile + VRAM_BANK_SIZE);
+// ----------------------------------------------------------------------------
+static void refresh_palettes(gbx_context_t *ctx)
+{
+    uint32_t *lut = ctx->video.color_lut;
+    int i, format = ctx->fb_format;
+
+    // every CGB color is converted once here, rather than on palette writes
+    if (!video_is_indexed(format)) {
+        for (i = 0; i < 0x8000; i++) {
+            lut[i] = rgb_to_pixel(color_profile_rgb(ctx->video.color_profile,
+                    ctx->video.color_gamma, i), format);
+        }
+    }
+
+    // the cached palettes are stored in the output format, so convert them
+    convert_cgb_palettes(ctx->video.bcpd_rgb, ctx->video.bcpd, lut, 0, format);
+    convert_cgb_palettes(ctx->video.ocpd_rgb, ctx->video.ocpd, lut,
+                         GBX_INDEX_OBJ, format);
+    video_write_mono_palette(ctx->video.bgp_rgb, ctx->video.bgp, format);
+    video_write_mono_palette(ctx->video.obp0_rgb, ctx->video.obp0, format);
+    video_write_mono_palette(ctx->video.obp1_rgb, ctx->video.obp1, format);
+
+    if (video_is_indexed(format))
+        ctx->video.black = 3;
+    else
+        ctx->video.black = rgb_to_pixel(monochrome_colors[3], format);
+
+    // a frame already in progress is finished with the new colors
+    if (ctx->video.frame_open)
+        render_set_format(&current_job(ctx)->rs, format, ctx->video.black);
+}
 
-        // determine whether the tile data is located in bank 0 or bank 1
-        if (attr & BG_ATTR_BANK)
-            pcolor += VRAM_BANK_SIZE;
+// ----------------------------------------------------------------------------
+void video_set_output(gbx_context_t *ctx, uint8_t *base, int pitch, int format)
+{
+    int i, frame_bytes = pitch * GBX_LCD_YRES;
 
-        if (attr & BG_ATTR_PRI)
-            bg_max_pri = 1;
+    wait_for_worker(ctx);
 
-        // check if we need to flip the tile in either the x or y direction
-        if (attr & BG_ATTR_XFLIP) off_x = 7 - off_x;
-        if (attr & BG_ATTR_YFLIP) off_y = 7 - off_y;
+    for (i = 0; i < GBX_FB_COUNT; i++) {
+        if (base)
+            ctx->fb_base[i] = base + i * frame_bytes;
+        else
+            ctx->fb_base[i] = (uint8_t *)ctx->fb[i];
+    }
 
-        palette = &ctx->video.bcpd_rgb[(attr & BG_ATTR_PAL) << 2];
+    ctx->fb_draw = ctx->fb_base[ctx->fb_back];
+    ctx->fb_pitch = pitch;
+
+    // frames published into the previous storage are discarded, and the next
+    // frame has to be presented in full
+    for (i = 0; i < GBX_FB_COUNT; i++) {
+        ctx->fb_slot[i].pixels = ctx->fb_base[i];
+        ctx->fb_slot[i].pitch = pitch;
+        ctx->fb_slot[i].format = format;
+        memset(ctx->fb_slot[i].dirty, 0xFF, sizeof(ctx->fb_slot[i].dirty));
     }
+    ctx->video.dirty_all = 1;
+    ctx->video.blend_reset = 1;
 
-    // tile character data may be indexed from either 0x8000 or 0x8800
-    if (ctx->video.lcdc & LCDC_BG_CHAR)
-        pcolor += (*ptile << 4) + (off_y << 1);
-    else
-        pcolor += 0x1000 + ((int8_t)*ptile << 4) + (off_y << 1);
+    ctx->fb_format = format;
+    refresh_palettes(ctx);
+}
 
-    // compute the color and store it in the framebuffer
-    ci = ((pcolor[0] >> off_x) & 1) | (((pcolor[1] >> off_x) << 1) & 2);
+// ----------------------------------------------------------------------------
+void video_set_color_profile(gbx_context_t *ctx, int profile, float gamma)
+{
+    wait_for_worker(ctx);
+    ctx->video.color_profile = profile;
+    ctx->video.color_gamma = gamma;
+    refresh_palettes(ctx);
+}
+
+// ----------------------------------------------------------------------------
+int video_set_frame_blend(gbx_context_t *ctx, int weight)
+{
+    uint16_t *acc = ctx->video.blend_acc;
 
-    // if no OBJ (or OBJ disabled) always draw BG, otherwise check priority
-    if (sprite < 0 || !ctx->video.show_obj || (bg_max_pri && ci))
-        ctx->fb[fb_pos] = palette[ci];
-    else 
-        ctx->fb[fb_pos] = ctx->video.line_col[x];
+    wait_for_worker(ctx);
+
+    if (weight && !acc) {
+        acc = (uint16_t *)malloc(GBX_FB_SIZE * 4 * sizeof(uint16_t));
+        if (!acc) {
+            log_err("unable to allocate the frame blending history\n");
+            return -1;
+        }
+        ctx->video.blend_acc = acc;
+    }
+
+    // the history starts over from the next frame whenever blending resumes
+    if (!ctx->video.blend_weight)
+        ctx->video.blend_reset = 1;
+    ctx->video.blend_weight = weight;
+    return 0;
 }
 
 // ----------------------------------------------------------------------------
@@ -444,8 +1222,8 @@ INLINE void transition_to_search(gbx_context_t *ctx)
     if (ctx->video.stat & STAT_INT_OAM)
         gbx_req_interrupt(ctx, INT_LCDSTAT);
 
-    // prepare the sprites for this scanline
-    prepare_line_buffer(ctx);
+    // sprites for this scanline are selected from the state at this cycle
+    current_job(ctx)->prep_dot[ctx->video.lcd_y] = ctx->video.dot;
 }
 
 // ----------------------------------------------------------------------------
@@ -454,6 +1232,9 @@ INLINE void transition_to_transfer(gbx_context_t *ctx)
     ctx->video.state = VIDEO_STATE_TRANSFER;
     ctx->video.cycle = 0;
 
+    // the first pixel of the scanline is drawn on the following cycle
+    current_job(ctx)->xfer_dot[ctx->video.lcd_y] = ctx->video.dot + 1;
+
     // no SEARCH STAT interrupt
     set_stat_mode(ctx, MODE_TRANSFER);
 }
@@ -482,6 +1263,21 @@ INLINE void transition_to_vblank(gbx_context_t *ctx)
 
 //  log_info("sync\n");
 
+    // draw the whole frame from its snapshot and the writes made since,
+    // handing it to the render worker instead if there is one
+    current_job(ctx)->cycles = ctx->cycles;
+    if (!ctx->video.frame_open) {
+        wait_for_worker(ctx);
+        video_publish_frame(ctx, ctx->cycles);
+    }
+    else if (ctx->video.worker)
+        submit_render_job(ctx);
+    else {
+        render_frame(ctx, current_job(ctx));
+        video_publish_frame(ctx, ctx->cycles);
+    }
+    ctx->video.frame_open = 0;
+
     ext_video_sync(ctx->userdata);
     gbx_req_interrupt(ctx, INT_VBLANK);
 
@@ -516,11 +1312,9 @@ void video_update_cycles(gbx_context_t *ctx, long cycles)
                 transition_to_transfer(ctx);
             break;
         case VIDEO_STATE_TRANSFER:
-            // render each pixel of the current scanline
-            if (ctx->video.lcd_x < GBX_LCD_XRES) {
-                video_render_pixel(ctx, ctx->video.lcd_x, ctx->video.lcd_y);
+            // pixels are drawn when the frame is replayed at v-blank
+            if (ctx->video.lcd_x < GBX_LCD_XRES)
                 ++ctx->video.lcd_x;
-            }
 
             // check for data transfer completion, transition to h-blank
             if (++ctx->video.cycle >= VIDEO_CYCLES_TRANSFER)
@@ -542,9 +1336,10 @@ void video_update_cycles(gbx_context_t *ctx, long cycles)
             // check for v-blank completion, transition to oam search
             if (++ctx->video.cycle >= VIDEO_CYCLES_SCANLINE) {
                 if (++ctx->video.lcd_y >= LCD_SCANLINE_COUNT) {
-                    transition_to_search(ctx);
+                    // reset LY first, the new frame starts from line 0
                     ctx->video.lcd_y = 0;
-                    ctx->video.curr_wy = 0;
+                    begin_frame(ctx);
+                    transition_to_search(ctx);
                 }
                 else
                     ctx->video.cycle = 0;
@@ -554,97 +1349,369 @@ void video_update_cycles(gbx_context_t *ctx, long cycles)
             }
             break;
         }
+
+        // writes made after this cycle are stamped with the next one
+        ++ctx->video.dot;
     }
 }
 
 // ----------------------------------------------------------------------------
-void gbx_get_tile_buffer(gbx_context_t *ctx, uint32_t *dest, int index)
+static void get_view_palette(gbx_context_t *ctx, int palette, uint32_t *dest)
 {
-    int x, y, off_x, off_y, tile, ci, pal_num = 0;
-    uint8_t *cb = NULL, *char_base = NULL;
+    const uint8_t *cpd;
+    int i, shades;
+
+    if (ctx->color_enabled) {
+        // palettes 0-7 are the BG palettes, 8-15 the OBJ palettes
+        cpd = (palette & 8) ? ctx->video.ocpd : ctx->video.bcpd;
+        cpd += (palette & 7) << 3;
+        for (i = 0; i < 4; i++) {
+            dest[i] = color_profile_rgb(ctx->video.color_profile,
+                                        ctx->video.color_gamma,
+                                        cpd[i << 1] | (cpd[(i << 1) | 1] << 8));
+        }
+        return;
+    }
 
-    uint32_t *palette = NULL;
-    if (ctx->color_enabled)
-        palette = &ctx->video.bcpd_rgb[pal_num << 2];
+    // monochrome palettes are BGP, OBP0 and OBP1, in that order
+    if (palette == 1)
+        shades = ctx->video.obp0;
+    else if (palette == 2)
+        shades = ctx->video.obp1;
     else
-        palette = ctx->video.bgp_rgb;
+        shades = ctx->video.bgp;
 
-    switch (index) {
-    default:
-    case 0: // bank 0 region 0
-        char_base = &ctx->mem.vram[0x0000];
-        break;
-    case 1: // bank 0 region 1
-        char_base = &ctx->mem.vram[0x0800];
-        break;
-    case 2: // bank 1 region 0
-        char_base = &ctx->mem.vram[0x0000 + VRAM_BANK_SIZE];
-        break;
-    case 3: // bank 1 region 1
-        char_base = &ctx->mem.vram[0x0800 + VRAM_BANK_SIZE];
-        break;
+    for (i = 0; i < 4; i++)
+        dest[i] = monochrome_colors[(shades >> (i << 1)) & 3];
+}
+
+// ----------------------------------------------------------------------------
+static void collect_vram_writes(gbx_context_t *ctx)
+{
+    video_registers_t *video = &ctx->video;
+    uint32_t bits;
+    int i, w;
+
+    // hand the writes made since any view was last updated to every view
+    for (w = 0; w < VRAM_DIRTY_WORDS; w++) {
+        if (!(bits = video->vram_dirty[w]))
+            continue;
+        for (i = 0; i < VRAM_VIEW_COUNT; i++) {
+            video->tile_view[i].dirty[w] |= bits;
+            video->tmap_view[i].dirty[w] |= bits;
+        }
+        video->vram_dirty[w] = 0;
     }
+}
 
-    for (y = 0; y < GBX_LCD_YRES; y++) {
-        for (x = 0; x < GBX_LCD_XRES; x++) {
+// ----------------------------------------------------------------------------
+INLINE int view_block_dirty(const vram_view_t *view, int offset)
+{
+    int block = offset >> 4;
+    return (view->dirty[block >> 5] >> (block & 31)) & 1;
+}
 
-            if (y >= 128 || x >= 128) {
-                dest[y * GBX_LCD_XRES + x] = 0x00000000;
-                continue;
-            }
+// ----------------------------------------------------------------------------
+static void draw_view_tile(uint32_t *dest, const uint8_t *pchar,
+                           const uint32_t *palette, int attr)
+{
+    int x, y, off_x, off_y, c1, c2;
 
-            tile = ((y >> 3) << 5) + (x >> 3);
-            off_x = 7 - (x & 7);
-            off_y = y & 7;
+    for (y = 0; y < 8; y++, dest += GBX_LCD_XRES) {
+        off_y = (attr & BG_ATTR_YFLIP) ? 7 - y : y;
+        c1 = pchar[off_y << 1];
+        c2 = pchar[(off_y << 1) | 1];
 
-            cb = &char_base[(tile << 4) + (off_y << 1)];
-            ci = ((cb[0] >> off_x) & 1) | (((cb[1] >> off_x) << 1) & 2);
-            dest[y * GBX_LCD_XRES + x] = palette[ci];
+        for (x = 0; x < 8; x++) {
+            off_x = (attr & BG_ATTR_XFLIP) ? x : 7 - x;
+            dest[x] = palette[((c1 >> off_x) & 1) | (((c2 >> off_x) << 1) & 2)];
         }
     }
 }
 
 // ----------------------------------------------------------------------------
-void gbx_get_tmap_buffer(gbx_context_t *ctx, uint32_t *dest, int index)
+static void add_view_rect(gbx_rect_t *rects, int *count, int max_rects,
+                          int x, int y, int w)
 {
-    int ci, x, y;
-    uint8_t *pcode, *pchar, *code_base = NULL;
-    uint32_t *palette = ctx->video.bgp_rgb;
+    gbx_rect_t *r;
+    int i, right, bottom;
+
+    // extend the run of tiles directly above if it spans the same columns
+    for (i = 0; i < *count; i++) {
+        r = &rects[i];
+        if (r->x == x && r->w == w && r->y + r->h == y) {
+            r->h += 8;
+            return;
+        }
+    }
 
-    switch (index) {
-    default:
-    case 0: case 1: // map 0 region 0/1
-        code_base = &ctx->mem.vram[0x1800];
-        break;
-    case 2: case 3: // map 1 region 0/1
-        code_base = &ctx->mem.vram[0x1C00];
-        break;
+    if (*count < max_rects) {
+        r = &rects[(*count)++];
+        r->x = x;
+        r->y = y;
+        r->w = w;
+        r->h = 8;
+        return;
     }
 
-    for (y = 0; y < GBX_LCD_YRES; y++) {
-        for (x = 0; x < GBX_LCD_XRES; x++) {
-            int off_x = 7 - (x & 7);
-            int off_y = y & 7;
-            int fb_pos = y * GBX_LCD_XRES + x;
-            pchar = ctx->mem.vram;
-            pcode = &code_base[((y & 0xF8) << 2) | (x >> 3)];
-
-            if (ctx->color_enabled) {
-                uint8_t attr = *(pcode + VRAM_BANK_SIZE);
-                if (attr & BG_ATTR_BANK) pchar += VRAM_BANK_SIZE;
-                if (attr & BG_ATTR_XFLIP) off_x = 7 - off_x;
-                if (attr & BG_ATTR_YFLIP) off_y = 7 - off_y;
-                palette = &ctx->video.bcpd_rgb[(attr & BG_ATTR_PAL) << 2];
+    // out of room, so grow the last rectangle to cover this one as well
+    r = &rects[max_rects - 1];
+    right = MAX(r->x + r->w, x + w);
+    bottom = MAX(r->y + r->h, y + 8);
+    r->x = MIN(r->x, x);
+    r->y = MIN(r->y, y);
+    r->w = right - r->x;
+    r->h = bottom - r->y;
+}
+
+// ----------------------------------------------------------------------------
+static int update_tile_view(gbx_context_t *ctx, uint32_t *dest, int index,
+                            int palette, gbx_rect_t *rects, int max_rects,
+                            int force)
+{
+    vram_view_t *view;
+    uint32_t colors[4];
+    int x, y, run, base, offset, redraw, count = 0;
+
+    if (index < 0 || index >= VRAM_VIEW_COUNT)
+        index = 0;
+    if ((index >> 1) >= ctx->mem.vram_banks)
+        index &= 1;
+    if (palette < 0 || palette > (ctx->color_enabled ? 15 : 2))
+        palette = 0;
+
+    collect_vram_writes(ctx);
+    get_view_palette(ctx, palette, colors);
+    view = &ctx->video.tile_view[index];
+
+    // everything is stale if drawn into another buffer or with other colors
+    redraw = force || view->dest != dest || view->palette != palette ||
+             memcmp(view->colors, colors, sizeof(colors));
+    if (redraw) {
+        for (y = 0; y < GBX_LCD_YRES; y++) {
+            for (x = (y < 128) ? 128 : 0; x < GBX_LCD_XRES; x++)
+                dest[y * GBX_LCD_XRES + x] = 0x00000000;
+        }
+        memcpy(view->colors, colors, sizeof(colors));
+        view->palette = palette;
+        view->dest = dest;
+    }
+
+    // the region holds 16 rows of 16 tiles, each row drawn in runs of tiles
+    base = ((index >> 1) * VRAM_BANK_SIZE) + ((index & 1) * 0x800);
+    for (y = 0; y < 16; y++) {
+        for (x = 0, run = 0; x <= 16; x++) {
+            offset = base + (((y << 4) + x) << 4);
+            if (x < 16 && (redraw || view_block_dirty(view, offset))) {
+                draw_view_tile(&dest[(y << 3) * GBX_LCD_XRES + (x << 3)],
+                               &ctx->mem.vram[offset], colors, 0);
+                ++run;
+            }
+            else if (run) {
+                add_view_rect(rects, &count, max_rects,
+                              (x - run) << 3, y << 3, run << 3);
+                run = 0;
             }
+        }
+    }
 
-            if (index & 1)
-                pchar += (*pcode << 4) + (off_y << 1);
-            else
-                pchar += 0x1000 + ((int8_t)*pcode << 4) + (off_y << 1);
+    if (redraw) {
+        rects[0].x = rects[0].y = 0;
+        rects[0].w = GBX_LCD_XRES;
+        rects[0].h = GBX_LCD_YRES;
+        count = 1;
+    }
 
-            ci = ((pchar[0] >> off_x) & 1) | (((pchar[1] >> off_x) << 1) & 2);
-            dest[fb_pos] = palette[ci];
+    memset(view->dirty, 0, sizeof(view->dirty));
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+static int update_tmap_view(gbx_context_t *ctx, uint32_t *dest, int index,
+                            gbx_rect_t *rects, int max_rects, int force)
+{
+    vram_view_t *view;
+    uint32_t colors[0x20];
+    int x, y, i, run, map, code, attr, offset, redraw, count = 0;
+    int palettes = ctx->color_enabled ? 8 : 1, pal_dirty = 0;
+
+    if (index < 0 || index >= VRAM_VIEW_COUNT)
+        index = 0;
+
+    collect_vram_writes(ctx);
+    view = &ctx->video.tmap_view[index];
+    redraw = force || view->dest != dest ||
+             view->palette != ctx->color_enabled;
+
+    // monochrome maps use BGP alone, color maps any of the eight BG palettes
+    for (i = 0; i < palettes; i++) {
+        get_view_palette(ctx, i, &colors[i << 2]);
+        if (memcmp(&view->colors[i << 2], &colors[i << 2], 4 * sizeof(*colors)))
+            pal_dirty |= 1 << i;
+    }
+    memcpy(view->colors, colors, palettes * 4 * sizeof(*colors));
+    view->palette = ctx->color_enabled;
+    view->dest = dest;
+
+    map = (index & 2) ? 0x1C00 : 0x1800;
+    for (y = 0; y < (GBX_LCD_YRES >> 3); y++) {
+        for (x = 0, run = 0; x <= (GBX_LCD_XRES >> 3); x++) {
+            if (x == (GBX_LCD_XRES >> 3)) {
+                code = -1;
+            }
+            else {
+                code = map + (y << 5) + x;
+                attr = 0;
+                if (ctx->color_enabled)
+                    attr = ctx->mem.vram[code + VRAM_BANK_SIZE];
+
+                // codes are signed in the region at 0x8800, unsigned at 0x8000
+                offset = (attr & BG_ATTR_BANK) ? VRAM_BANK_SIZE : 0;
+                if (index & 1)
+                    offset += 0x1000 + ((int8_t)ctx->mem.vram[code] << 4);
+                else
+                    offset += ctx->mem.vram[code] << 4;
+
+                // redraw if the entry, its tile or its palette has changed
+                if (!redraw && !view_block_dirty(view, code) &&
+                    !view_block_dirty(view, offset) &&
+                    !(pal_dirty & (1 << (attr & BG_ATTR_PAL))) &&
+                    !(ctx->color_enabled &&
+                      view_block_dirty(view, code + VRAM_BANK_SIZE)))
+                    code = -1;
+            }
+
+            if (code >= 0) {
+                draw_view_tile(&dest[(y << 3) * GBX_LCD_XRES + (x << 3)],
+                               &ctx->mem.vram[offset],
+                               &colors[(attr & BG_ATTR_PAL) << 2], attr);
+                ++run;
+            }
+            else if (run) {
+                add_view_rect(rects, &count, max_rects,
+                              (x - run) << 3, y << 3, run << 3);
+                run = 0;
+            }
         }
     }
+
+    memset(view->dirty, 0, sizeof(view->dirty));
+    return count;
+}
+
+// ----------------------------------------------------------------------------
+void gbx_get_tile_buffer(gbx_context_t *ctx, uint32_t *dest, int index)
+{
+    gbx_rect_t rect;
+    update_tile_view(ctx, dest, index, 0, &rect, 1, 1);
+}
+
+// ----------------------------------------------------------------------------
+void gbx_get_tmap_buffer(gbx_context_t *ctx, uint32_t *dest, int index)
+{
+    gbx_rect_t rect;
+    update_tmap_view(ctx, dest, index, &rect, 1, 1);
+}
+
+// ----------------------------------------------------------------------------
+// Draw the 256 tiles of a tile data region into the top left 128x128 pixels
+// of dest, always in RGBX8888. Bit 0 of index selects the region at 0x8000 or
+// 0x8800, bit 1 the VRAM bank. Palette is BGP, OBP0 or OBP1 in monochrome
+// mode, or 0-7 for the BG and 8-15 for the OBJ palettes in color mode. Only
+// the tiles written since the last update of the same index and buffer are
+// redrawn. Returns the number of rectangles stored in rects that cover what
+// changed, 0 if nothing did, merging the last ones if max_rects runs out.
+int gbx_update_tile_buffer(gbx_context_t *ctx, uint32_t *dest, int index,
+                           int palette, gbx_rect_t *rects, int max_rects)
+{
+    assert(NULL != ctx);
+    assert(NULL != rects && max_rects > 0);
+    return update_tile_view(ctx, dest, index, palette, rects, max_rects, 0);
 }
 
+// ----------------------------------------------------------------------------
+// Draw the top left 20x18 entries of a tile map into dest, always in RGBX8888.
+// Bit 1 of index selects the map at 0x9800 or 0x9C00, bit 0 the tile data
+// region as for gbx_update_tile_buffer, with unsigned codes from 0x8000 or
+// signed codes from 0x8800. In color mode each entry is drawn with the bank,
+// flips and BG palette from its attributes. Only the entries whose code,
+// attributes, tile or palette changed since the last update are redrawn, and
+// the changed areas are returned as for gbx_update_tile_buffer.
+int gbx_update_tmap_buffer(gbx_context_t *ctx, uint32_t *dest, int index,
+                           gbx_rect_t *rects, int max_rects)
+{
+    assert(NULL != ctx);
+    assert(NULL != rects && max_rects > 0);
+    return update_tmap_view(ctx, dest, index, rects, max_rects, 0);
+}
+
+// ----------------------------------------------------------------------------
+static uint32_t index_to_rgb(gbx_context_t *ctx, int index)
+{
+    uint8_t *cpd;
+
+    if (!ctx->color_enabled)
+        return monochrome_colors[index & 3];
+    if (index >= GBX_INDEX_WHITE)
+        return monochrome_colors[0];
+
+    // look up the color currently held by the BG or OBJ palette entry
+    cpd = (index >= GBX_INDEX_OBJ) ? ctx->video.ocpd : ctx->video.bcpd;
+    index = (index & 0x1F) << 1;
+    return color_profile_rgb(ctx->video.color_profile, ctx->video.color_gamma,
+                             cpd[index] | (cpd[index + 1] << 8));
+}
+
+// ----------------------------------------------------------------------------
+// Convert a frame of any output format to packed RGBX8888, for when a person
+// needs to look at it. Indices are resolved against the palettes as they are
+// now, and the PACKED2 colors of a color frame are shown as grey levels.
+void gbx_expand_frame(gbx_context_t *ctx, const gbx_frame_t *frame,
+                      uint32_t *dest)
+{
+    const uint8_t *row = (const uint8_t *)frame->pixels;
+    const uint32_t *row32;
+    int x, y, shift;
+
+    for (y = 0; y < GBX_LCD_YRES; y++, row += frame->pitch) {
+        row32 = (const uint32_t *)row;
+        switch (frame->format) {
+        case GBX_PIXEL_INDEX8:
+            for (x = 0; x < GBX_LCD_XRES; x++)
+                *dest++ = index_to_rgb(ctx, row[x]);
+            break;
+        case GBX_PIXEL_PACKED2:
+            for (x = 0; x < GBX_LCD_XRES; x++) {
+                shift = (3 - (x & 3)) << 1;
+                *dest++ = monochrome_colors[(row[x >> 2] >> shift) & 3];
+            }
+            break;
+        case GBX_PIXEL_RGB888:
+            for (x = 0; x < GBX_LCD_XRES * 3; x += 3)
+                *dest++ = row[x] | (row[x + 1] << 8) | (row[x + 2] << 16);
+            break;
+        case GBX_PIXEL_BGR888:
+            for (x = 0; x < GBX_LCD_XRES * 3; x += 3)
+                *dest++ = row[x + 2] | (row[x + 1] << 8) | (row[x] << 16);
+            break;
+        case GBX_PIXEL_RGB565:
+            for (x = 0; x < GBX_LCD_XRES; x++) {
+                int p = ((const uint16_t *)row)[x];
+                *dest++ = ((p >> 8) & 0xF8) | ((p >> 13) & 0x07) |
+                          ((p << 5) & 0xFC00) | ((p >> 1) & 0x0300) |
+                          ((p << 19) & 0xF80000) | ((p << 14) & 0x070000);
+            }
+            break;
+        case GBX_PIXEL_BGRX8888:
+            for (x = 0; x < GBX_LCD_XRES; x++) {
+                *dest++ = (row32[x] & 0xFF00FF00) |
+                          ((row32[x] >> 16) & 0xFF) | ((row32[x] & 0xFF) << 16);
+            }
+            break;
+        default:
+            memcpy(dest, row32, GBX_LCD_XRES * 4);
+            dest += GBX_LCD_XRES;
+            break;
+        }
+    }
+}
@@ -42,6 +42,42 @@
 #define GBX_LCD_XRES    160
 #define GBX_LCD_YRES    144
 
+// frames are rendered into one of three buffers and published atomically
+
+#define GBX_FB_COUNT    3
+#define GBX_FB_SIZE     (GBX_LCD_XRES * GBX_LCD_YRES)
+#define FB_INDEX        0x03    // buffer index of the published frame
+#define FB_FRESH        0x04    // published frame not yet acquired
+
+// each frame carries a bitmask of the scanlines changed since the last one
+
+#define GBX_DIRTY_WORDS ((GBX_LCD_YRES + 31) / 32)
+
+// output pixel formats, named by the order of the bytes in memory
+
+#define GBX_PIXEL_RGBX8888  0   // default, same layout as GL_RGBA bytes
+#define GBX_PIXEL_BGRX8888  1
+#define GBX_PIXEL_RGB888    2
+#define GBX_PIXEL_BGR888    3
+#define GBX_PIXEL_INDEX8    4   // one palette index per byte, see below
+#define GBX_PIXEL_PACKED2   5   // four 2-bit shades per byte, leftmost high
+#define GBX_PIXEL_RGB565    6   // native 16-bit words, red in the high bits
+#define GBX_PIXEL_LAST      GBX_PIXEL_RGB565
+
+// in the index formats, monochrome frames store the shade (0 = white through
+// 3 = black) after BGP/OBP mapping. color frames store palette * 4 + color,
+// offset by GBX_INDEX_OBJ for object palettes. PACKED2 keeps only the color
+
+#define GBX_INDEX_OBJ       0x20    // first index of the OBJ palettes
+#define GBX_INDEX_WHITE     0x40    // color frames only, LCD disabled
+
+// conversions from 15-bit CGB colors to the output format
+
+#define GBX_COLOR_RAW       0   // default, each channel scaled linearly
+#define GBX_COLOR_LCD       1   // approximate the colors of the CGB screen
+#define GBX_COLOR_GAMMA     2   // each channel through a custom gamma curve
+#define GBX_COLOR_LAST      GBX_COLOR_GAMMA
+
 // LCD control (LCDC) fields
 
 #define LCDC_BG_EN      0x01    // background display enable
@@ -109,6 +145,8 @@
 #define VIDEO_CYCLES_TOTAL      70224
 
 #define LCD_SCANLINE_COUNT      154
+#define LCD_SPRITES_PER_LINE    10
+#define OAM_SPRITE_COUNT        40
 
 typedef struct obj_char {
     uint8_t ypos;               // y-axis coordinate
@@ -117,18 +155,93 @@ typedef struct obj_char {
     uint8_t attr;               // attribute data
 } obj_char_t;
 
-typedef struct video_registers {
+// PPU writes made during a frame are journaled and replayed at v-blank
+
+#define VIDEO_WRITE_VRAM        0   // target is the offset into both banks
+#define VIDEO_WRITE_OAM         1   // target is the offset into OAM
+#define VIDEO_WRITE_PORT        2   // target is the I/O port (LCDC, SCX, ...)
+#define VIDEO_WRITE_BCPD        3   // target is the BG palette byte index
+#define VIDEO_WRITE_OCPD        4   // target is the OBJ palette byte index
+#define VIDEO_WRITE_COLOR       5   // color mode enabled or disabled
+
+typedef struct video_write {
+    int dot;                    // LCD cycle in the frame the write was made
+    uint16_t target;
+    uint8_t type, value;
+} video_write_t;
+
+// copy of everything the renderer reads, taken at the start of each frame
+
+typedef struct render_state {
+    uint8_t vram[2 * 0x2000];   // both banks, regardless of system type
+    uint8_t oam[0x100];
     int line_obj[GBX_LCD_XRES]; // object lookup for each column in scanline
     int line_col[GBX_LCD_XRES];
+    int format;                 // output format of the cached palettes
+    const uint32_t *color_lut;  // CGB color to output format, see below
+    int system, color_enabled;
+    uint32_t black;             // drawn where neither BG nor window is shown
     int show_bg;                // enable display of background
     int show_wnd;               // enable display of window
     int show_obj;               // enable display of objects
     int obj_pri;                // enable forced object priority over bg/wnd
+    int lcdc;
+    int scy, scx;
+    int wx, wy, curr_wy;
+    int bgp, obp0, obp1;
+    uint32_t bgp_rgb[4];
+    uint32_t obp0_rgb[4];
+    uint32_t obp1_rgb[4];
+    uint8_t bcpd[0x40];
+    uint8_t ocpd[0x40];
+    uint32_t bcpd_rgb[0x20];
+    uint32_t ocpd_rgb[0x20];
+    int wnd_code;               // offset of the window tile map in VRAM
+    int bg_code;                // offset of the background tile map in VRAM
+    int sprite_hmax;
+    int sprite_mask;
+    void (*draw_tiles)(struct render_state *rs, uint32_t *fb, int x, int end,
+                       int map, int bx, int by); // chosen from LCDC and mode
+    int obj_index_valid;        // cleared on OAM write or OBJ size change
+    uint8_t obj_count[LCD_SCANLINE_COUNT];
+    uint8_t obj_index[LCD_SCANLINE_COUNT][LCD_SPRITES_PER_LINE];
+} render_state_t;
+
+// a frame to be rendered: the starting state plus the writes made during it
+
+typedef struct render_job {
+    render_state_t rs;
+    video_write_t *writes;
+    int write_count, write_size;
+    int prep_dot[GBX_LCD_YRES]; // LCD cycle of the OAM search of each line
+    int xfer_dot[GBX_LCD_YRES]; // LCD cycle at which the first pixel is drawn
+    long cycles;                // emulated cycle count at the end of the frame
+} render_job_t;
+
+// the VRAM viewers redraw only what was written since they were last updated
+
+#define VRAM_BLOCK_COUNT    (2 * 0x2000 / 16) // one per tile in both banks
+#define VRAM_DIRTY_WORDS    (VRAM_BLOCK_COUNT / 32)
+#define VRAM_VIEW_COUNT     4   // bank or map, tile data region
+
+typedef struct vram_view {
+    uint32_t dirty[VRAM_DIRTY_WORDS]; // blocks written since the last update
+    uint32_t colors[0x20];      // RGBX palettes the view was last drawn with
+    const uint32_t *dest;       // buffer the view was last drawn into
+    int palette;                // palette (tile) or color mode (map) drawn
+} vram_view_t;
+
+typedef struct video_registers {
+    uint32_t line_buf[GBX_LCD_XRES]; // line staged before it is stored
+    uint32_t line_prev[GBX_LCD_YRES][GBX_LCD_XRES]; // previous frame contents
+    uint32_t dirty[GBX_DIRTY_WORDS]; // scanlines changed in the current frame
+    int dirty_all;              // flag every scanline of the current frame
+    uint32_t black;             // drawn where neither BG nor window is shown
     int state, cycle;
     int lcdc, stat, lyc;
     int lcd_x, lcd_y;
     int scy, scx;
-    int wx, wy, curr_wy;
+    int wx, wy;
     int bgp, obp0, obp1;
     uint32_t bgp_rgb[4];
     uint32_t obp0_rgb[4];
@@ -138,14 +251,30 @@ typedef struct video_registers {
     uint8_t ocpd[0x40];
     uint32_t bcpd_rgb[0x20];
     uint32_t ocpd_rgb[0x20];
+    uint32_t color_lut[0x8000]; // every CGB color in the output format
+    uint16_t *blend_acc;        // 8.8 fixed point history of each channel
+    int blend_weight;           // share of the history in 1/256ths, 0 = off
+    int blend_reset;            // next frame replaces the history
+    int color_profile;          // one of GBX_COLOR_*
+    float color_gamma;          // exponent for GBX_COLOR_GAMMA
     uint16_t hdma_src, hdma_dst;
     int hdma_len, hdma_active, hdma_pos;
-    uint8_t *wnd_code;
-    uint8_t *bg_code;
-    int sprite_hmax;
-    int sprite_mask;
+    int dot;                    // LCD cycles elapsed in the current frame
+    int frame_open;             // writes are being journaled into the job
+    render_job_t jobs[2];       // one recorded while the other is rendered
+    int curr_job;               // index of the job being recorded
+    struct render_worker *worker; // renders completed jobs, if enabled
+    uint32_t vram_dirty[VRAM_DIRTY_WORDS]; // not yet seen by any view
+    vram_view_t tile_view[VRAM_VIEW_COUNT];
+    vram_view_t tmap_view[VRAM_VIEW_COUNT];
 } video_registers_t;
 
+// ----------------------------------------------------------------------------
+INLINE void video_mark_vram(video_registers_t *video, int offset)
+{
+    video->vram_dirty[offset >> 9] |= 1u << ((offset >> 4) & 31);
+}
+
 // ----------------------------------------------------------------------------
 INLINE uint16_t video_validate_hdma_src(uint16_t addr)
 {
@@ -171,17 +300,42 @@ INLINE uint16_t video_validate_hdma_dst(uint16_t addr)
 }
 
 // ----------------------------------------------------------------------------
-INLINE uint32_t cgb_color_to_rgb(uint16_t c)
+INLINE int video_is_indexed(int format)
+{
+    return format == GBX_PIXEL_INDEX8 || format == GBX_PIXEL_PACKED2;
+}
+
+// ----------------------------------------------------------------------------
+INLINE int video_row_bytes(int format)
 {
-    return ((c & 0x001F) << 3) | ((c & 0x03E0) << 6) | ((c & 0x7C00) << 9);
+    switch (format) {
+    case GBX_PIXEL_RGB888:
+    case GBX_PIXEL_BGR888:
+        return GBX_LCD_XRES * 3;
+    case GBX_PIXEL_RGB565:
+        return GBX_LCD_XRES * 2;
+    case GBX_PIXEL_INDEX8:
+        return GBX_LCD_XRES;
+    case GBX_PIXEL_PACKED2:
+        return GBX_LCD_XRES / 4;
+    default:
+        return GBX_LCD_XRES * 4;
+    }
 }
 
-void video_write_mono_palette(uint32_t *dest, uint8_t value);
+void video_write_mono_palette(uint32_t *dest, uint8_t value, int format);
 void video_write_lcdc(gbx_context_t *ctx, uint8_t value);
 void video_write_bcpd(gbx_context_t *ctx, uint8_t value);
 void video_write_ocpd(gbx_context_t *ctx, uint8_t value);
 void video_write_hdma(gbx_context_t *ctx, uint8_t value);
 void video_write_stat(gbx_context_t *ctx, uint8_t value);
+void video_journal_write(gbx_context_t *ctx, int type, int target,
+                         uint8_t value);
+void video_publish_frame(gbx_context_t *ctx, long cycles);
+void video_set_output(gbx_context_t *ctx, uint8_t *base, int pitch, int fmt);
+void video_set_color_profile(gbx_context_t *ctx, int profile, float gamma);
+int  video_set_frame_blend(gbx_context_t *ctx, int weight);
+void video_commit_line(gbx_context_t *ctx, int y, const uint32_t *src);
 uint8_t video_read_hdma(gbx_context_t *ctx);
 uint8_t video_read_stat(gbx_context_t *ctx);
 void video_update_cycles(gbx_context_t *ctx, long cycles);
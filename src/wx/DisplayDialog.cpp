@@ -27,6 +27,8 @@ DisplayDialog::DisplayDialog(wxWindow *parent)
     m_outputModule->SetSelection(0);
 
     m_filterType->Append("None");
+    m_filterType->Append("Scale2x");
+    m_filterType->Append("Scale3x");
     m_filterType->SetSelection(0);
 
     m_videoScaling->SetSelection(0);
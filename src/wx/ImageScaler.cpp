@@ -0,0 +1,332 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#include <string.h>
+#include "ImageScaler.h"
+
+#if defined(SIMD_SSE2)
+#include <emmintrin.h>
+#endif
+
+// ----------------------------------------------------------------------------
+ImageScaler::ImageScaler()
+: m_filter(SCALER_FILTER_NONE), m_smooth(false)
+{
+}
+
+// ----------------------------------------------------------------------------
+const uint32_t *ImageScaler::Scale(const uint32_t *src, int sw, int sh,
+                                   int width, int height)
+{
+    if (m_filter == SCALER_FILTER_SCALE2X) {
+        m_stage.resize(sw * sh * 4);
+        Scale2x(src, sw, sh, &m_stage[0]);
+        src = &m_stage[0];
+        sw *= 2;
+        sh *= 2;
+    }
+    else if (m_filter == SCALER_FILTER_SCALE3X) {
+        m_stage.resize(sw * sh * 9);
+        Scale3x(src, sw, sh, &m_stage[0]);
+        src = &m_stage[0];
+        sw *= 3;
+        sh *= 3;
+    }
+
+    if (sw == width && sh == height)
+        return src;
+
+    m_output.resize(width * height);
+    if (m_smooth)
+        Bilinear(src, sw, sh, &m_output[0], width, height);
+    else
+        Nearest(src, sw, sh, &m_output[0], width, height);
+    return &m_output[0];
+}
+
+// ----------------------------------------------------------------------------
+static void ExpandRow(const uint32_t *src, int sw, uint32_t *dst, int kx)
+{
+    int x = 0, i;
+
+#if defined(SIMD_SSE2)
+    __m128i v;
+
+    // the common factors are built from whole registers of four pixels
+    if (kx == 2) {
+        for (; x + 4 <= sw; x += 4, dst += 8) {
+            v = _mm_loadu_si128((const __m128i *)&src[x]);
+            _mm_storeu_si128((__m128i *)&dst[0], _mm_unpacklo_epi32(v, v));
+            _mm_storeu_si128((__m128i *)&dst[4], _mm_unpackhi_epi32(v, v));
+        }
+    }
+    else if (kx == 3) {
+        for (; x + 4 <= sw; x += 4, dst += 12) {
+            v = _mm_loadu_si128((const __m128i *)&src[x]);
+            _mm_storeu_si128((__m128i *)&dst[0],
+                             _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 0, 0)));
+            _mm_storeu_si128((__m128i *)&dst[4],
+                             _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 1, 1)));
+            _mm_storeu_si128((__m128i *)&dst[8],
+                             _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 2)));
+        }
+    }
+    else if (kx >= 4) {
+        for (; x < sw; x++) {
+            v = _mm_set1_epi32((int)src[x]);
+            for (i = 0; i + 4 <= kx; i += 4, dst += 4)
+                _mm_storeu_si128((__m128i *)dst, v);
+            for (; i < kx; i++)
+                *dst++ = src[x];
+        }
+    }
+#endif
+
+    for (; x < sw; x++) {
+        for (i = 0; i < kx; i++)
+            *dst++ = src[x];
+    }
+}
+
+// ----------------------------------------------------------------------------
+void ImageScaler::Nearest(const uint32_t *src, int sw, int sh,
+                          uint32_t *dst, int dw, int dh)
+{
+    const uint32_t *row;
+    int x, y, sy, prev = -1;
+
+    // integer factors expand each source row once, then repeat it
+    if (dw % sw == 0 && dh % sh == 0) {
+        int kx = dw / sw, ky = dh / sh;
+        for (y = 0; y < sh; y++) {
+            ExpandRow(&src[y * sw], sw, dst, kx);
+            for (x = 1; x < ky; x++)
+                memcpy(&dst[x * dw], dst, dw * sizeof(uint32_t));
+            dst += dw * ky;
+        }
+        return;
+    }
+
+    for (y = 0; y < dh; y++, dst += dw) {
+        sy = y * sh / dh;
+        if (sy == prev) {
+            memcpy(dst, dst - dw, dw * sizeof(uint32_t));
+            continue;
+        }
+
+        row = &src[sy * sw];
+        for (x = 0; x < dw; x++)
+            dst[x] = row[x * sw / dw];
+        prev = sy;
+    }
+}
+
+// ----------------------------------------------------------------------------
+static void PadRow(const uint32_t *row, int sw, uint32_t *pad)
+{
+    // repeat the first and last pixel so each one has a left and right
+    pad[0] = row[0];
+    memcpy(&pad[1], row, sw * sizeof(uint32_t));
+    pad[sw + 1] = row[sw - 1];
+}
+
+// ----------------------------------------------------------------------------
+void ImageScaler::Scale2x(const uint32_t *src, int sw, int sh, uint32_t *dst)
+{
+    std::vector<uint32_t> pad(sw + 2);
+    const uint32_t *b, *h, *e = &pad[1];
+    uint32_t *d0, *d1;
+    int x, y;
+
+    for (y = 0; y < sh; y++) {
+        b = &src[(y > 0 ? y - 1 : y) * sw];
+        h = &src[(y < sh - 1 ? y + 1 : y) * sw];
+        d0 = &dst[(y * 2) * (sw * 2)];
+        d1 = d0 + sw * 2;
+        PadRow(&src[y * sw], sw, &pad[0]);
+        x = 0;
+
+#if defined(SIMD_SSE2)
+        // four pixels at a time, each rule becomes a mask to select with
+        for (; x + 4 <= sw; x += 4) {
+            __m128i B = _mm_loadu_si128((const __m128i *)&b[x]);
+            __m128i H = _mm_loadu_si128((const __m128i *)&h[x]);
+            __m128i D = _mm_loadu_si128((const __m128i *)&e[x - 1]);
+            __m128i E = _mm_loadu_si128((const __m128i *)&e[x]);
+            __m128i F = _mm_loadu_si128((const __m128i *)&e[x + 1]);
+            __m128i DB = _mm_cmpeq_epi32(D, B), BF = _mm_cmpeq_epi32(B, F);
+            __m128i DH = _mm_cmpeq_epi32(D, H), HF = _mm_cmpeq_epi32(H, F);
+            __m128i c0 = _mm_andnot_si128(BF, _mm_andnot_si128(DH, DB));
+            __m128i c1 = _mm_andnot_si128(DB, _mm_andnot_si128(HF, BF));
+            __m128i c2 = _mm_andnot_si128(DB, _mm_andnot_si128(HF, DH));
+            __m128i c3 = _mm_andnot_si128(DH, _mm_andnot_si128(BF, HF));
+            __m128i e0 = _mm_or_si128(_mm_and_si128(c0, D),
+                                      _mm_andnot_si128(c0, E));
+            __m128i e1 = _mm_or_si128(_mm_and_si128(c1, F),
+                                      _mm_andnot_si128(c1, E));
+            __m128i e2 = _mm_or_si128(_mm_and_si128(c2, D),
+                                      _mm_andnot_si128(c2, E));
+            __m128i e3 = _mm_or_si128(_mm_and_si128(c3, F),
+                                      _mm_andnot_si128(c3, E));
+
+            _mm_storeu_si128((__m128i *)&d0[x * 2],
+                             _mm_unpacklo_epi32(e0, e1));
+            _mm_storeu_si128((__m128i *)&d0[x * 2 + 4],
+                             _mm_unpackhi_epi32(e0, e1));
+            _mm_storeu_si128((__m128i *)&d1[x * 2],
+                             _mm_unpacklo_epi32(e2, e3));
+            _mm_storeu_si128((__m128i *)&d1[x * 2 + 4],
+                             _mm_unpackhi_epi32(e2, e3));
+        }
+#endif
+
+        for (; x < sw; x++) {
+            uint32_t B = b[x], H = h[x], D = e[x - 1], E = e[x], F = e[x + 1];
+            d0[x * 2 + 0] = (D == B && B != F && D != H) ? D : E;
+            d0[x * 2 + 1] = (B == F && B != D && F != H) ? F : E;
+            d1[x * 2 + 0] = (D == H && D != B && H != F) ? D : E;
+            d1[x * 2 + 1] = (H == F && D != H && B != F) ? F : E;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+void ImageScaler::Scale3x(const uint32_t *src, int sw, int sh, uint32_t *dst)
+{
+    std::vector<uint32_t> above(sw + 2), pad(sw + 2), below(sw + 2);
+    const uint32_t *a = &above[1], *e = &pad[1], *g = &below[1];
+    uint32_t *d0, *d1, *d2;
+    int x, y;
+
+    // the nine outputs of each pixel share few comparisons, so this one is
+    // left to the compiler
+    for (y = 0; y < sh; y++) {
+        PadRow(&src[(y > 0 ? y - 1 : y) * sw], sw, &above[0]);
+        PadRow(&src[y * sw], sw, &pad[0]);
+        PadRow(&src[(y < sh - 1 ? y + 1 : y) * sw], sw, &below[0]);
+        d0 = &dst[(y * 3) * (sw * 3)];
+        d1 = d0 + sw * 3;
+        d2 = d1 + sw * 3;
+
+        for (x = 0; x < sw; x++, d0 += 3, d1 += 3, d2 += 3) {
+            uint32_t A = a[x - 1], B = a[x], C = a[x + 1];
+            uint32_t D = e[x - 1], E = e[x], F = e[x + 1];
+            uint32_t G = g[x - 1], H = g[x], I = g[x + 1];
+            bool db = D == B && B != F && D != H;
+            bool bf = B == F && B != D && F != H;
+            bool dh = D == H && D != B && H != F;
+            bool hf = H == F && D != H && B != F;
+
+            d0[0] = db ? D : E;
+            d0[1] = ((db && E != C) || (bf && E != A)) ? B : E;
+            d0[2] = bf ? F : E;
+            d1[0] = ((db && E != G) || (dh && E != A)) ? D : E;
+            d1[1] = E;
+            d1[2] = ((bf && E != I) || (hf && E != C)) ? F : E;
+            d2[0] = dh ? D : E;
+            d2[1] = ((dh && E != I) || (hf && E != G)) ? H : E;
+            d2[2] = hf ? F : E;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+static int SamplePosition(int i, int src_size, int dst_size)
+{
+    // centers of the destination pixels in source pixels, in 1/256ths
+    int pos = (2 * i + 1) * src_size * 128 / dst_size - 128;
+    return MIN(MAX(pos, 0), (src_size - 1) * 256);
+}
+
+// ----------------------------------------------------------------------------
+void ImageScaler::Bilinear(const uint32_t *src, int sw, int sh,
+                           uint32_t *dst, int dw, int dh)
+{
+    const uint8_t *r0, *r1;
+    uint16_t *t, *w;
+    int x, y, i, pos, fx, fy;
+
+    // each column blends the pixel at x0 and the next, the second weight
+    // covering the fraction. both are scaled by 128 for mulhi below, as the
+    // full weight of 256 would no longer fit 16 bits when scaled by 256
+    m_columns.resize(dw);
+    m_weights.resize(dw * 8);
+    for (x = 0; x < dw; x++) {
+        pos = SamplePosition(x, sw, dw);
+        m_columns[x] = pos >> 8;
+        fx = pos & 0xFF;
+        for (i = 0; i < 4; i++) {
+            m_weights[x * 8 + i] = (uint16_t)((256 - fx) << 7);
+            m_weights[x * 8 + 4 + i] = (uint16_t)(fx << 7);
+        }
+    }
+
+    // the row has one extra pixel so the last column can read past the end
+    m_row.resize((sw + 1) * 4);
+    t = &m_row[0];
+
+    for (y = 0; y < dh; y++, dst += dw) {
+        pos = SamplePosition(y, sh, dh);
+        fy = pos & 0xFF;
+        r0 = (const uint8_t *)&src[(pos >> 8) * sw];
+        r1 = (const uint8_t *)&src[MIN((pos >> 8) + 1, sh - 1) * sw];
+
+        // blend the two source rows into 8.8 fixed point channels
+        i = 0;
+#if defined(SIMD_SSE2)
+        __m128i zero = _mm_setzero_si128();
+        __m128i w0 = _mm_set1_epi16((short)(256 - fy));
+        __m128i w1 = _mm_set1_epi16((short)fy);
+        for (; i + 16 <= sw * 4; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *)&r0[i]);
+            __m128i b = _mm_loadu_si128((const __m128i *)&r1[i]);
+            _mm_storeu_si128((__m128i *)&t[i], _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0),
+                _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1)));
+            _mm_storeu_si128((__m128i *)&t[i + 8], _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0),
+                _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1)));
+        }
+#endif
+        for (; i < sw * 4; i++)
+            t[i] = (uint16_t)(r0[i] * (256 - fy) + r1[i] * fy);
+        for (i = 0; i < 4; i++)
+            t[sw * 4 + i] = t[(sw - 1) * 4 + i];
+
+        // then blend neighboring columns, which leaves 8.7 fixed point, and
+        // round back to 8-bit channels
+        for (x = 0; x < dw; x++) {
+            const uint16_t *p0 = &t[m_columns[x] * 4];
+            w = &m_weights[x * 8];
+#if defined(SIMD_SSE2)
+            __m128i p = _mm_loadu_si128((const __m128i *)p0);
+            p = _mm_mulhi_epu16(p, _mm_loadu_si128((const __m128i *)w));
+            p = _mm_add_epi16(p, _mm_srli_si128(p, 8));
+            p = _mm_srli_epi16(_mm_add_epi16(p, _mm_set1_epi16(64)), 7);
+            p = _mm_packus_epi16(p, p);
+            dst[x] = (uint32_t)_mm_cvtsi128_si32(p);
+#else
+            uint8_t *out = (uint8_t *)&dst[x];
+            for (i = 0; i < 4; i++) {
+                uint32_t c = (((uint32_t)p0[i] * w[i]) >> 16) +
+                             (((uint32_t)p0[4 + i] * w[4 + i]) >> 16);
+                out[i] = (uint8_t)((c + 64) >> 7);
+            }
+#endif
+        }
+    }
+}
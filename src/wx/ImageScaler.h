@@ -0,0 +1,62 @@
+// gboy - a portable gameboy emulator
+// Copyright (C) 2011  Garrett Smith.
+// 
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+// 
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+// for more details.
+// 
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#ifndef GBOY_IMAGESCALER__H
+#define GBOY_IMAGESCALER__H
+
+#include "common.h"
+#include <vector>
+
+// pixel art filters applied before the image is resized to the window
+
+#define SCALER_FILTER_NONE      0
+#define SCALER_FILTER_SCALE2X   1
+#define SCALER_FILTER_SCALE3X   2
+
+// Resizes packed 32-bit pixels (any channel order, each channel one byte) in
+// software. Every image is tightly packed, with the width as the pitch.
+class ImageScaler
+{
+public:
+    ImageScaler();
+
+    void SetFilter(int filter) { m_filter = filter; }
+    void SetSmooth(bool smooth) { m_smooth = smooth; }
+
+    // apply the filter, then resize to width x height. returns the result,
+    // which is either src itself or remains valid until the next call
+    const uint32_t *Scale(const uint32_t *src, int sw, int sh,
+                          int width, int height);
+
+    static void Nearest(const uint32_t *src, int sw, int sh,
+                        uint32_t *dst, int dw, int dh);
+    static void Scale2x(const uint32_t *src, int sw, int sh, uint32_t *dst);
+    static void Scale3x(const uint32_t *src, int sw, int sh, uint32_t *dst);
+    void Bilinear(const uint32_t *src, int sw, int sh,
+                  uint32_t *dst, int dw, int dh);
+
+protected:
+    int m_filter;
+    bool m_smooth;
+    std::vector<uint32_t> m_stage;      // output of the pixel art filter
+    std::vector<uint32_t> m_output;     // image at the final size
+    std::vector<int> m_columns;         // bilinear left pixel of each column
+    std::vector<uint16_t> m_weights;    // bilinear weights for each column
+    std::vector<uint16_t> m_row;        // bilinear vertical blend of a row
+};
+
+#endif // GBOY_IMAGESCALER__H
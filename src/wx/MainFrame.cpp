@@ -97,6 +97,10 @@ void MainFrame::LoadConfiguration()
     m_config->Read("filter_type", &m_filterType, 0);
     m_config->Read("scale_type", &m_scalingType, 0);
     m_config->Read("vsync_enable", &vsync, false);
+    m_config->Read("render_thread", &m_renderThread, false);
+    m_config->Read("color_profile", &m_colorProfile, GBX_COLOR_RAW);
+    m_config->Read("color_gamma", &m_colorGamma, 1.0);
+    m_config->Read("frame_blend", &m_frameBlend, 0);
 
     // load key mappings
     static const int default_keycodes[8] = {
@@ -145,6 +149,10 @@ void MainFrame::SaveConfiguration()
     m_config->Write("filter_type", m_render->FilterType());
     m_config->Write("scale_type", m_render->ScalingType());
     m_config->Write("vsync_enable", VsyncEnabled());
+    m_config->Write("render_thread", m_renderThread);
+    m_config->Write("color_profile", m_colorProfile);
+    m_config->Write("color_gamma", m_colorGamma);
+    m_config->Write("frame_blend", m_frameBlend);
 
     // save key mappings
     m_config->SetPath("/input");
@@ -283,6 +291,10 @@ void MainFrame::CreateRenderWidget(int type)
         m_filterEnable = m_render->StretchFilter();
         m_filterType = m_render->FilterType();
         m_scalingType = m_render->ScalingType();
+
+        // stop rendering into memory owned by the widget before freeing it
+        if (m_gbx)
+            m_gbx->SetFramebufferTarget(NULL, 0, m_render->PixelFormat());
         SAFE_DELETE(m_render);
     }
 
@@ -300,6 +312,9 @@ void MainFrame::CreateRenderWidget(int type)
 
     m_render->Window()->SetSize(GetClientSize());
     m_render->Window()->SetFocus();
+
+    if (m_gbx)
+        AttachFramebufferTarget();
 }
 
 // ----------------------------------------------------------------------------
@@ -314,6 +329,30 @@ void MainFrame::CreateEmulatorContext()
     if (wxTHREAD_NO_ERROR != m_gbx->Create()) {
         wxLogError("Failed to create gbx thread!");
     }
+
+    if (m_renderThread && !m_gbx->SetRenderThreadEnabled(true))
+        wxLogError("Failed to create render thread!");
+
+    if (!m_gbx->SetColorProfile(m_colorProfile, (float)m_colorGamma))
+        wxLogError("Invalid color profile in configuration!");
+
+    if (!m_gbx->SetFrameBlend(m_frameBlend))
+        wxLogError("Invalid frame blend weight in configuration!");
+
+    AttachFramebufferTarget();
+}
+
+// ----------------------------------------------------------------------------
+void MainFrame::AttachFramebufferTarget()
+{
+    assert(NULL != m_gbx);
+    assert(NULL != m_render);
+
+    // render directly into the widget's memory when it provides any, otherwise
+    // into the core's own buffers using the widget's preferred pixel format
+    int pitch = 0;
+    void *target = m_render->FramebufferTarget(GBX_FB_COUNT, &pitch);
+    m_gbx->SetFramebufferTarget(target, pitch, m_render->PixelFormat());
 }
 
 // ----------------------------------------------------------------------------
@@ -524,9 +563,15 @@ void MainFrame::OnDisplayDialog(wxCommandEvent &event)
             CreateRenderWidget(m_outputModule);
         }
 
+        int filterType = m_render->FilterType();
         m_render->SetStretchFilter(dialog->FilterEnabled());
         m_render->SetFilterType(dialog->FilterType());
         m_render->SetScalingType(dialog->ScalingType());
+
+        // whether the widget takes frames in its own memory depends on the
+        // filter, so offer it again when that changes
+        if (filterType != m_render->FilterType())
+            AttachFramebufferTarget();
     }
 
     m_gbx->SetPaused(oldPauseState);
@@ -607,7 +652,11 @@ void MainFrame::OnGbxVideoSync(wxThreadEvent &event)
     assert(NULL != m_gbx);
     assert(NULL != m_render);
 
-    m_render->UpdateFramebuffer(m_gbx->Framebuffer());
+    // several sync events may be queued, only the first sees a new frame
+    gbx_frame_t frame;
+    m_render->WaitForUpload();
+    if (m_gbx->AcquireFrame(&frame))
+        m_render->UpdateFramebuffer(frame);
 }
 
 // ----------------------------------------------------------------------------
@@ -52,6 +52,7 @@ protected:
 
     void CreateRenderWidget(int type);
     void CreateEmulatorContext();
+    void AttachFramebufferTarget();
 
     void SetStatusBarEnabled(bool enable);
     void SetToolBarEnabled(bool enable);
@@ -123,10 +124,14 @@ protected:
     KeyMap         m_keymap;
     bool           m_vsync;
     bool           m_filterEnable;
+    bool           m_renderThread;
+    double         m_colorGamma;
     long           m_lastCycles;
     int            m_outputModule;
     int            m_filterType;
     int            m_scalingType;
+    int            m_colorProfile;
+    int            m_frameBlend;
     PrecisionTimer m_timer;
 };
 
@@ -19,7 +19,10 @@
 #include <wx/bitmap.h>
 #include <wx/brush.h>
 #include <wx/dcbuffer.h>
+#include <wx/image.h>
 #include <wx/rawbmp.h>
+#include <vector>
+#include "ImageScaler.h"
 #include "RenderWidget.h"
 
 class BitmapWidget: public wxPanel
@@ -28,7 +31,7 @@ public:
     BitmapWidget(wxWindow *parent, int width, int height);
     virtual ~BitmapWidget();
 
-    void UpdateFramebuffer(const uint32_t *fb);
+    void UpdateFramebuffer(const gbx_frame_t &frame);
     void ClearFramebuffer(uint8_t value);
 
     void SetStretchFilter(bool enable);
@@ -42,11 +45,15 @@ public:
 protected:
     void UpdateDimensions();
     void ComputeAspectCorrectDimensions(int cx, int cy);
+    void UpdateBitmap();
     void OnSize(wxSizeEvent &event);
     void OnPaint(wxPaintEvent &event);
 
 protected:
-    wxBitmap *m_bmp;
+    std::vector<uint32_t> m_frame;  // latest frame, at the LCD resolution
+    ImageScaler m_scaler;
+    wxBitmap m_bitmap;              // frame scaled to the viewport
+    bool m_bitmapStale;
     bool m_filterEnable;
     int m_filterType;
     int m_scalingType;
@@ -64,12 +71,15 @@ public:
     virtual void Create(wxWindow *parent, int width, int height) {
         m_panel = new BitmapWidget(parent, width, height);
     }
-    virtual void UpdateFramebuffer(const uint32_t *fb) {
-        m_panel->UpdateFramebuffer(fb);
+    virtual void UpdateFramebuffer(const gbx_frame_t &frame) {
+        m_panel->UpdateFramebuffer(frame);
     }
     virtual void ClearFramebuffer(uint8_t value) {
         m_panel->ClearFramebuffer(value);
     }
+    virtual void *FramebufferTarget(int frames, int *pitch) { return NULL; }
+    virtual void WaitForUpload() { }
+    virtual int PixelFormat() { return GBX_PIXEL_RGBX8888; }
     virtual void SetStretchFilter(bool enable) {
         m_panel->SetStretchFilter(enable);
     }
@@ -94,13 +104,14 @@ protected:
 // ----------------------------------------------------------------------------
 BitmapWidget::BitmapWidget(wxWindow *parent, int width, int height)
 : wxPanel(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxWANTS_CHARS),
-  m_filterEnable(false), m_filterType(0), m_scalingType(0)
+  m_bitmapStale(true), m_filterEnable(false), m_filterType(0),
+  m_scalingType(0), m_x(0), m_y(0), m_w(0), m_h(0)
 {
     m_width  = width;
     m_height = height;
     m_aspect = (float)m_width / m_height;
 
-    m_bmp = new wxBitmap(m_width, m_height, 24);
+    m_frame.resize(m_width * m_height);
     ClearFramebuffer(0);
 
     SetBackgroundStyle(wxBG_STYLE_CUSTOM);
@@ -121,12 +132,18 @@ BitmapWidget::~BitmapWidget()
 void BitmapWidget::SetStretchFilter(bool enable)
 {
     m_filterEnable = enable;
+    m_scaler.SetSmooth(enable);
+    m_bitmapStale = true;
+    Refresh(false);
 }
 
 // ----------------------------------------------------------------------------
 void BitmapWidget::SetFilterType(int index)
 {
     m_filterType = index;
+    m_scaler.SetFilter(index);
+    m_bitmapStale = true;
+    Refresh(false);
 }
 
 // ----------------------------------------------------------------------------
@@ -134,49 +151,82 @@ void BitmapWidget::SetScalingType(int index)
 {
     m_scalingType = index;
     UpdateDimensions();
+    m_bitmapStale = true;
 }
 
 // ----------------------------------------------------------------------------
-void BitmapWidget::UpdateFramebuffer(const uint32_t *fb)
+void BitmapWidget::UpdateFramebuffer(const gbx_frame_t &frame)
 {
-    wxNativePixelData data(*m_bmp);
-    wxNativePixelData::Iterator p(data);
-
-    for ( int y = 0; y < m_height; ++y ) {
-        wxNativePixelData::Iterator rowStart = p;
-        for ( int x = 0; x < m_width; ++x, ++p ) {
-            uint32_t color = fb[y * m_width + x];
-            p.Red()   = color & 0xFF;
-            p.Green() = (color >> 8) & 0xFF;
-            p.Blue()  = (color >> 16) & 0xFF;
-        }
+    // frames are rendered as packed RGBX, which the scalers work on directly
+    const uint8_t *src = (const uint8_t *)frame.pixels;
+    uint8_t *dest = (uint8_t *)&m_frame[0];
+    const int row_bytes = m_width * 4;
+    int y = 0, rows, changed = 0;
+
+    // copy only the rows that changed, and skip the repaint if none did
+    while (0 != (rows = gbx_next_dirty_rows(&frame, &y))) {
+        for (changed += rows; rows > 0; ++y, --rows)
+            memcpy(dest + y * row_bytes, src + y * frame.pitch, row_bytes);
+    }
 
-        p = rowStart;
-        p.OffsetY(data, 1);
+    if (changed) {
+        m_bitmapStale = true;
+        Refresh(false);
     }
+}
 
+// ----------------------------------------------------------------------------
+void BitmapWidget::ClearFramebuffer(uint8_t value)
+{
+    memset(&m_frame[0], value, m_width * m_height * 4);
+    m_bitmapStale = true;
     Refresh(true);
 }
 
 // ----------------------------------------------------------------------------
-void BitmapWidget::ClearFramebuffer(uint8_t value)
+void BitmapWidget::UpdateBitmap()
 {
-    wxNativePixelData data(*m_bmp);
-    wxNativePixelData::Iterator p(data);
-
-    for (int y = 0; y < m_height; ++y) {
-        wxNativePixelData::Iterator rowStart = p;
-        for (int x = 0; x < m_width; ++x, ++p) {
-            p.Red()   = value;
-            p.Green() = value;
-            p.Blue()  = value;
+    const uint32_t *src;
+    const uint8_t *in;
+    uint8_t *out;
+    int x, y;
+
+    m_bitmapStale = false;
+    if (m_w <= 0 || m_h <= 0)
+        return;
+
+    // filter and resize the frame, then convert it straight into the bitmap
+    src = m_scaler.Scale(&m_frame[0], m_width, m_height, m_w, m_h);
+    if (!m_bitmap.IsOk() || m_bitmap.GetWidth() != m_w ||
+        m_bitmap.GetHeight() != m_h)
+        m_bitmap.Create(m_w, m_h, 24);
+
+    wxNativePixelData data(m_bitmap);
+    if (!data) {
+        // no direct access on this platform, go through an image instead
+        wxImage img(m_w, m_h, false);
+        in = (const uint8_t *)src;
+        out = img.GetData();
+        for (x = 0; x < m_w * m_h; x++, in += 4, out += 3) {
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = in[2];
         }
-
-        p = rowStart;
-        p.OffsetY(data, 1);
+        m_bitmap = wxBitmap(img);
+        return;
     }
 
-    Refresh(true);
+    wxNativePixelData::Iterator row(data);
+    for (y = 0; y < m_h; y++, row.OffsetY(data, 1)) {
+        in = (const uint8_t *)&src[y * m_w];
+        out = (uint8_t *)row.m_ptr;
+        for (x = 0; x < m_w; x++, in += 4) {
+            out[wxNativePixelFormat::RED] = in[0];
+            out[wxNativePixelFormat::GREEN] = in[1];
+            out[wxNativePixelFormat::BLUE] = in[2];
+            out += wxNativePixelFormat::SizePixel;
+        }
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -230,6 +280,7 @@ void BitmapWidget::ComputeAspectCorrectDimensions(int cx, int cy)
 void BitmapWidget::OnSize(wxSizeEvent &event)
 {
     UpdateDimensions();
+    m_bitmapStale = true;
     Refresh(true);
 }
 
@@ -241,8 +292,11 @@ void BitmapWidget::OnPaint(wxPaintEvent &event)
     dc.SetBackground(*wxBLACK_BRUSH);
     dc.Clear();
 
-    wxImage img(m_bmp->ConvertToImage());
-    dc.DrawBitmap(wxBitmap(img.Scale(m_w, m_h)), m_x, m_y, false);
+    // the scaled bitmap is only rebuilt when the frame or viewport changes
+    if (m_bitmapStale)
+        UpdateBitmap();
+    if (m_bitmap.IsOk() && m_w > 0 && m_h > 0)
+        dc.DrawBitmap(m_bitmap, m_x, m_y, false);
 }
 
 // ----------------------------------------------------------------------------
@@ -23,29 +23,11 @@
 #include <GL/glxew.h>
 #endif
 #include <wx/glcanvas.h>
+#include <vector>
+#include "present.h"
+#include "ImageScaler.h"
 #include "RenderWidget.h"
 
-typedef struct vertex {
-    float x, y, z;
-    float s, t;
-    float _padding[3];
-} vertex_t;
-
-// ----------------------------------------------------------------------------
-// Return the nearest square, pow2 texture dimension >= MAX(width, height).
-unsigned int tex_pow2(unsigned int width, unsigned int height)
-{
-    unsigned int input = MAX(width, height);
-    unsigned int value = 2;
-
-    if (0 == (input & (input - 1)))
-        return input;
-
-    while (0 != (input >>= 1))
-        value <<= 1;
-    return value;
-}
-
 class GL2Widget: public wxGLCanvas
 {
 public:
@@ -53,8 +35,10 @@ public:
               int *attrib, int width, int height);
     virtual ~GL2Widget();
 
-    void UpdateFramebuffer(const uint32_t *fb);
+    void UpdateFramebuffer(const gbx_frame_t &frame);
     void ClearFramebuffer(uint8_t value);
+    void *FramebufferTarget(int frames, int *pitch);
+    void WaitForUpload();
 
     void SetStretchFilter(bool enable);
     void SetFilterType(int index);
@@ -68,6 +52,7 @@ public:
 
 protected:
     void InitGL();
+    void UploadImage();
     void UpdateDimensions();
     void ComputeAspectCorrectDimensions(int cx, int cy);
 
@@ -79,17 +64,14 @@ protected:
 protected:
     wxGLContext *m_context;
     bool m_filterEnable;
-    GLuint m_vbo;
-    GLuint m_pbo;
-    GLuint m_texture;
+    present_t m_present;
+    ImageScaler m_scaler;
+    std::vector<uint32_t> m_frame;      // copy of the frame while filtering
     int m_width, m_height;
-    int m_pboSize;
-    int m_textureDim;
     int m_filterType;
     int m_scalingType;
     int m_swapInterval;
     float m_aspect;
-    float m_tu, m_tv;
     float m_x0, m_y0, m_x1, m_y1;
 };
 
@@ -104,12 +86,19 @@ public:
         parent->Show(true); // XXX: must be visible to access context
         m_panel = new GL2Widget(parent, NULL, attrib_list, width, height);
     }
-    virtual void UpdateFramebuffer(const uint32_t *fb) {
-        m_panel->UpdateFramebuffer(fb);
+    virtual void UpdateFramebuffer(const gbx_frame_t &frame) {
+        m_panel->UpdateFramebuffer(frame);
     }
     virtual void ClearFramebuffer(uint8_t value) {
         m_panel->ClearFramebuffer(value);
     }
+    virtual void *FramebufferTarget(int frames, int *pitch) {
+        return m_panel->FramebufferTarget(frames, pitch);
+    }
+    virtual void WaitForUpload() {
+        m_panel->WaitForUpload();
+    }
+    virtual int PixelFormat() { return GBX_PIXEL_RGBX8888; }
     virtual void SetStretchFilter(bool enable) {
         m_panel->SetStretchFilter(enable);
     }
@@ -137,8 +126,8 @@ protected:
 GL2Widget::GL2Widget(wxWindow *parent, wxGLContext *context,
                      int *attrib, int width, int height)
 : wxGLCanvas(parent, wxID_ANY, attrib, wxDefaultPosition, wxDefaultSize,
-  wxWANTS_CHARS), m_context(context), m_filterEnable(false), m_filterType(0),
-  m_scalingType(0)
+  wxWANTS_CHARS), m_context(context), m_filterEnable(false),
+  m_filterType(0), m_scalingType(0)
 {
     if (!m_context)
         m_context = new wxGLContext(this);
@@ -151,6 +140,7 @@ GL2Widget::GL2Widget(wxWindow *parent, wxGLContext *context,
     m_width  = width;
     m_height = height;
     m_aspect = (float)m_width / m_height;
+    m_frame.resize(width * height);
 
     SetCurrent(*m_context);
     InitGL();
@@ -165,16 +155,29 @@ GL2Widget::~GL2Widget()
 void GL2Widget::SetStretchFilter(bool enable)
 {
     m_filterEnable = enable;
-    GLint filter = enable ? GL_LINEAR : GL_NEAREST;
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    SetCurrent(*m_context);
+    present_set_filter(&m_present, enable);
 }
 
 // ----------------------------------------------------------------------------
 void GL2Widget::SetFilterType(int index)
 {
+    bool filtered = m_filterType != SCALER_FILTER_NONE;
+
+    if (index == m_filterType)
+        return;
+
     m_filterType = index;
+    m_scaler.SetFilter(index);
+
+    // keep showing the current frame, which is only in the texture when it
+    // wasn't being filtered
+    SetCurrent(*m_context);
+    if (!filtered)
+        present_read(&m_present, &m_frame[0]);
+    UploadImage();
+    Refresh(false);
 }
 
 // ----------------------------------------------------------------------------
@@ -206,43 +209,64 @@ void GL2Widget::SetSwapInterval(int interval)
 }
 
 // ----------------------------------------------------------------------------
-void GL2Widget::UpdateFramebuffer(const uint32_t *fb)
+void GL2Widget::UpdateFramebuffer(const gbx_frame_t &frame)
 {
-    SetCurrent(*m_context);
-
-    // lock the pbo for write only access and copy over the framebuffer
-    glBufferData(GL_PIXEL_UNPACK_BUFFER, m_pboSize, NULL, GL_DYNAMIC_DRAW);
-    void *pbuf = (void *)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+    const uint8_t *src = (const uint8_t *)frame.pixels;
+    uint8_t *dest = (uint8_t *)&m_frame[0];
+    const int row_bytes = m_width * 4;
+    int y = 0, rows, changed = 0;
 
-    memcpy(pbuf, (const void *)fb, m_pboSize);
+    // upload only the runs of rows that changed, and skip the repaint if none
+    SetCurrent(*m_context);
+    if (m_filterType == SCALER_FILTER_NONE) {
+        if (present_upload(&m_present, &frame))
+            Refresh(false);
+        return;
+    }
 
-    // unlock the pbo
-    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
-            m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    // the pixel art filters look at neighboring rows, so a filtered frame is
+    // copied out and the whole image is uploaded again
+    while (0 != (rows = gbx_next_dirty_rows(&frame, &y))) {
+        for (changed += rows; rows > 0; ++y, --rows)
+            memcpy(dest + y * row_bytes, src + y * frame.pitch, row_bytes);
+    }
 
-    // force the widget to update its contents
-    Refresh(false);
+    if (changed) {
+        UploadImage();
+        Refresh(false);
+    }
 }
 
 // ----------------------------------------------------------------------------
 void GL2Widget::ClearFramebuffer(uint8_t value)
 {
-    SetCurrent(*m_context);
+    memset(&m_frame[0], value, m_width * m_height * 4);
 
-    // lock the pbo for write only access and copy over the framebuffer
-    glBufferData(GL_PIXEL_UNPACK_BUFFER, m_pboSize, NULL, GL_DYNAMIC_DRAW);
-    void *pbuf = (void *)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+    SetCurrent(*m_context);
+    present_clear(&m_present, value);
+    Refresh(false);
+}
 
-    memset(pbuf, value, m_pboSize);
+// ----------------------------------------------------------------------------
+void *GL2Widget::FramebufferTarget(int frames, int *pitch)
+{
+    // map a ring of pbos for the lifetime of the widget so the emulator can
+    // render straight into memory the driver uploads from, if the driver allows
+    // it. filtered frames are copied out instead, which is slow from there
+    if (m_filterType != SCALER_FILTER_NONE) {
+        *pitch = 0;
+        return NULL;
+    }
 
-    // unlock the pbo
-    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
-            m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    SetCurrent(*m_context);
+    return present_map_target(&m_present, frames, pitch);
+}
 
-    // force the widget to update its contents
-    Refresh(false);
+// ----------------------------------------------------------------------------
+void GL2Widget::WaitForUpload()
+{
+    SetCurrent(*m_context);
+    present_wait(&m_present);
 }
 
 // ----------------------------------------------------------------------------
@@ -253,50 +277,14 @@ void GL2Widget::InitGL()
         // log_err("failed to initialize GLEW (%s)\n", glewGetErrorString(rc));
     }
 
-    m_pboSize = m_width * m_height * 4;
-    m_textureDim = tex_pow2(m_width, m_height);
-
-    m_tu = m_width  / (float)m_textureDim;
-    m_tv = m_height / (float)m_textureDim;
-
     m_x0 = m_y0 = -1.0f;
     m_x1 = m_y1 = 1.0f;
 
-    // set some reasonable defaults for rendering a 2d scene
-    glClearColor(0, 0, 0, 0);
-
-    glShadeModel(GL_FLAT);
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_LIGHTING);
-    glDisable(GL_CULL_FACE);
-    glEnable(GL_TEXTURE_2D);
-
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-
-    // create the render texture and pbo
-    glGenTextures(1, &m_texture);
-    glBindTexture(GL_TEXTURE_2D, m_texture);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-            m_textureDim, m_textureDim, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-
-    glGenBuffers(1, &m_pbo);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
-
-    // generate the vertex buffer
-    glGenBuffers(1, &m_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertex) * 4, NULL, GL_STREAM_DRAW);
+    // create the render texture, the static vbo holding the quad, and set
+    // some reasonable defaults for rendering a 2d scene
+    if (0 != present_init(&m_present, m_width, m_height)) {
+        // log_err("failed to initialize the OpenGL renderer\n");
+    }
 
     //log_info("OpenGL2 renderer successfully initialized\n");
 
@@ -305,6 +293,23 @@ void GL2Widget::InitGL()
     UpdateDimensions();
 }
 
+// ----------------------------------------------------------------------------
+void GL2Widget::UploadImage()
+{
+    int scale = 1;
+
+    if (m_filterType == SCALER_FILTER_SCALE2X)
+        scale = 2;
+    else if (m_filterType == SCALER_FILTER_SCALE3X)
+        scale = 3;
+
+    // filter the copy of the frame and upload it at the size the filter made
+    if (scale != m_present.scale)
+        present_set_scale(&m_present, scale);
+    present_upload_image(&m_present, m_scaler.Scale(&m_frame[0],
+            m_width, m_height, m_width * scale, m_height * scale));
+}
+
 // ----------------------------------------------------------------------------
 void GL2Widget::UpdateDimensions()
 {
@@ -336,6 +341,8 @@ void GL2Widget::UpdateDimensions()
             ComputeAspectCorrectDimensions(cx, cy);
         }
     }
+
+    present_place(&m_present, m_x0, m_y0, m_x1, m_y1);
 }
 
 // ----------------------------------------------------------------------------
@@ -358,10 +365,7 @@ void GL2Widget::ComputeAspectCorrectDimensions(int cx, int cy)
 void GL2Widget::OnCloseWindow(wxCloseEvent &evt)
 {
     SetCurrent(*m_context);
-
-    glDeleteBuffers(1, &m_vbo);
-    glDeleteBuffers(1, &m_pbo);
-    glDeleteTextures(1, &m_texture);
+    present_shutdown(&m_present);
 
     evt.Skip();
 }
@@ -380,14 +384,7 @@ void GL2Widget::OnPaint(wxPaintEvent &evt)
     wxPaintDC dc(this);
 
     SetCurrent(*m_context);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    glBegin(GL_QUADS);
-    glTexCoord2f(0.0f, m_tv); glVertex3f(m_x0, m_y0, 0.0f); 
-    glTexCoord2f(m_tu, m_tv); glVertex3f(m_x1, m_y0, 0.0f); 
-    glTexCoord2f(m_tu, 0.0f); glVertex3f(m_x1, m_y1, 0.0f); 
-    glTexCoord2f(0.0f, 0.0f); glVertex3f(m_x0, m_y1, 0.0f);
-    glEnd();
+    present_draw(&m_present);
 
     SwapBuffers();
 }
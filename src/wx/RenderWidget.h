@@ -18,7 +18,7 @@
 #ifndef GBOY_RENDERWIDGET__H
 #define GBOY_RENDERWIDGET__H
 
-#include "common.h"
+#include "gbx.h"
 #include <wx/wx.h>
 
 class RenderWidget
@@ -27,9 +27,16 @@ public:
     virtual ~RenderWidget() { }
 
     virtual void Create(wxWindow *parent, int width, int height) = 0;
-    virtual void UpdateFramebuffer(const uint32_t *fb) = 0;
+    virtual void UpdateFramebuffer(const gbx_frame_t &frame) = 0;
     virtual void ClearFramebuffer(uint8_t value) = 0;
 
+    // memory the emulator may render frames into directly, or NULL if none
+    virtual void *FramebufferTarget(int frames, int *pitch) = 0;
+    // block until the last upload no longer reads from that memory, which
+    // must happen before the next frame is acquired and the memory reused
+    virtual void WaitForUpload() = 0;
+    virtual int PixelFormat() = 0;
+
     virtual void SetStretchFilter(bool enable) = 0;
     virtual void SetFilterType(int index) = 0;
     virtual void SetScalingType(int index) = 0;
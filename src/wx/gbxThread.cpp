@@ -42,16 +42,6 @@ void ext_lcd_enabled(void *data, int enabled)
     ((gbxThread *)data)->PostLCDEnabled(enabled);
 }
 
-// ----------------------------------------------------------------------------
-void ext_sound_write(void *data, uint16_t addr, uint8_t value)
-{
-}
-
-// ----------------------------------------------------------------------------
-void ext_sound_read(void *data, uint16_t addr, uint8_t *value)
-{
-}
-
 // ----------------------------------------------------------------------------
 void ext_sound_frame(void *data)
 {
@@ -67,6 +57,9 @@ gbxThread::gbxThread(wxEvtHandler *parent, int system)
         log_err("failed to create gbx context\n");
 
     gbx_set_userdata(m_ctx, this);
+
+    // there is no sound output yet, so only the sound registers are emulated
+    gbx_set_audio_synthesis(m_ctx, 0);
 }
 
 // ----------------------------------------------------------------------------
@@ -159,7 +152,6 @@ void gbxThread::DynamicSleep()
 // ----------------------------------------------------------------------------
 void gbxThread::PostVideoSync()
 {
-    gbx_get_framebuffer(m_ctx, m_framebuffer);
     wxThreadEvent evt(wxEVT_GBX_SYNC, wxID_ANY);
     wxQueueEvent(m_parent, evt.Clone());
 
@@ -249,9 +241,41 @@ void gbxThread::SetInputState(int key, int pressed)
 }
 
 // ----------------------------------------------------------------------------
-const uint32_t *gbxThread::Framebuffer() const
+void gbxThread::SetFramebufferTarget(void *target, int pitch, int format)
+{
+    // must be called from the GUI thread, as it also discards held frames
+    wxCriticalSectionLocker locker(m_cs);
+    if (gbx_set_framebuffer_target(m_ctx, target, pitch, format))
+        gbx_set_framebuffer_target(m_ctx, NULL, 0, format);
+}
+
+// ----------------------------------------------------------------------------
+bool gbxThread::SetRenderThreadEnabled(bool enabled)
+{
+    // frames are drawn on a worker while the next one is emulated
+    wxCriticalSectionLocker locker(m_cs);
+    return gbx_set_render_thread(m_ctx, enabled ? 1 : 0) == 0;
+}
+
+// ----------------------------------------------------------------------------
+bool gbxThread::SetColorProfile(int profile, float gamma)
+{
+    wxCriticalSectionLocker locker(m_cs);
+    return gbx_set_color_profile(m_ctx, profile, gamma) == 0;
+}
+
+// ----------------------------------------------------------------------------
+bool gbxThread::SetFrameBlend(int weight)
+{
+    wxCriticalSectionLocker locker(m_cs);
+    return gbx_set_frame_blend(m_ctx, weight) == 0;
+}
+
+// ----------------------------------------------------------------------------
+bool gbxThread::AcquireFrame(gbx_frame_t *frame)
 {
-    return m_framebuffer;
+    // lock-free, the emulator publishes into a separate buffer meanwhile
+    return gbx_acquire_frame(m_ctx, frame) != 0;
 }
 
 // ----------------------------------------------------------------------------
@@ -40,8 +40,12 @@ public:
     bool SetDebuggerEnabled(bool enabled);
     bool SetThrottleEnabled(bool throttle);
     void SetInputState(int key, int pressed);
+    void SetFramebufferTarget(void *target, int pitch, int format);
+    bool SetRenderThreadEnabled(bool enabled);
+    bool SetColorProfile(int profile, float gamma);
+    bool SetFrameBlend(int weight);
 
-    const uint32_t *Framebuffer() const;
+    bool AcquireFrame(gbx_frame_t *frame);
     const wxString &BiosDir() const;
     bool Paused() const;
     bool BatteryBacked() const;
@@ -70,7 +74,6 @@ protected:
     wxCondition m_pauseCond;
     mutable wxCriticalSection m_cs;
     gbx_context_t *m_ctx;
-    uint32_t m_framebuffer[GBX_LCD_XRES * GBX_LCD_YRES];
     bool m_running;
     bool m_paused;
     bool m_throttle;